@@ -0,0 +1,129 @@
+#include "AllocationCounter.hpp"
+#include "Model3D.hpp"
+#include "MeshCache.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// Replacing the global allocation functions costs every allocation of the program, the decode
+// workers' included, a few atomic increments, so it is only built for benchmark runs
+#ifdef GPS_COUNT_ALLOCATIONS
+
+// The replaced global allocation functions only bump relaxed counters
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> freeCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+
+static void* countedAlloc(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+static void countedFree(void* block) {
+    if (block != NULL) {
+        freeCount.fetch_add(1, std::memory_order_relaxed);
+        std::free(block);
+    }
+}
+
+void* operator new(size_t size) {
+    void* block = countedAlloc(size);
+    if (block == NULL) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new[](size_t size) {
+    void* block = countedAlloc(size);
+    if (block == NULL) {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAlloc(size);
+}
+
+void operator delete(void* block) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block) noexcept {
+    countedFree(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    countedFree(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    countedFree(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    countedFree(block);
+}
+
+#endif /* GPS_COUNT_ALLOCATIONS */
+
+namespace gps {
+
+    bool isAllocationCountingEnabled() {
+#ifdef GPS_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    AllocationStats getAllocationStats() {
+        AllocationStats stats;
+#ifdef GPS_COUNT_ALLOCATIONS
+        stats.allocations = allocationCount.load(std::memory_order_relaxed);
+        stats.frees = freeCount.load(std::memory_order_relaxed);
+        stats.bytes = allocatedBytes.load(std::memory_order_relaxed);
+#endif
+        return stats;
+    }
+
+    void benchmarkModelLoads(int fileCount, const char* const* fileNames) {
+        if (!isAllocationCountingEnabled()) {
+            std::cout << "Allocation counting is off; build with GPS_COUNT_ALLOCATIONS defined to count heap allocations" << std::endl;
+        }
+        for (int i = 0; i < fileCount; i++) {
+            // the first load parses the .obj and writes a fresh cache, the second one reads that cache
+            std::remove(MeshCache::cachePathFor(fileNames[i]).c_str());
+            const char* passes[2] = {"parsed", "cached"};
+            for (int pass = 0; pass < 2; pass++) {
+                AllocationStats before = getAllocationStats();
+                ModelStats stats;
+                {
+                    Model3D model;
+                    model.LoadModel(fileNames[i]);
+                    stats = model.getStats();
+                }
+                AllocationStats after = getAllocationStats();
+
+                std::cout << "LoadModel " << fileNames[i] << " (" << passes[pass] << ") : ";
+                if (isAllocationCountingEnabled()) {
+                    std::cout << (after.allocations - before.allocations) << " allocations, " << (after.bytes - before.bytes) << " bytes, ";
+                }
+                std::cout << stats.peakLoadBytes << " peak bytes, " << stats.loadTimeMs << " ms" << std::endl;
+            }
+        }
+    }
+}
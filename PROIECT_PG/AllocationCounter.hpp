@@ -0,0 +1,26 @@
+#ifndef AllocationCounter_hpp
+#define AllocationCounter_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Totals of the global operator new/delete since the program started; they are only
+    // counted when the program is built with GPS_COUNT_ALLOCATIONS defined, and stay zero otherwise
+    struct AllocationStats {
+        size_t allocations = 0;
+        size_t frees = 0;
+        size_t bytes = 0;
+    };
+
+    bool isAllocationCountingEnabled();
+
+    AllocationStats getAllocationStats();
+
+    // Counts the heap allocations and bytes of LoadModel for each .obj file, once parsing it
+    // (replacing its mesh cache) and once reading the cache that load wrote. Without
+    // GPS_COUNT_ALLOCATIONS only the peak load memory and the load time are reported.
+    void benchmarkModelLoads(int fileCount, const char* const* fileNames);
+}
+
+#endif /* AllocationCounter_hpp */
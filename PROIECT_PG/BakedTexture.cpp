@@ -0,0 +1,314 @@
+#include "BakedTexture.hpp"
+#include "ImageKernels.hpp"
+#include "TextureLoader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gps {
+
+    static const char BAKED_TEXTURE_MAGIC[4] = {'G', 'P', 'S', 'T'};
+
+    struct BakedTextureHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levelCount;
+        // stamp of the source image; a mismatch invalidates the baked file
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        // settings the file was baked with; format above may be BC3 where BC1 was requested
+        uint32_t colorSpace;
+        uint32_t requestedFormat;
+        uint32_t quality;
+        uint32_t reserved;
+    };
+
+    struct BakedTextureLevelRecord {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static bool sourceStamp(std::string fileName, uint64_t* size, int64_t* mtime) {
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+        *size = (uint64_t)info.st_size;
+        *mtime = (int64_t)info.st_mtime;
+        return true;
+    }
+
+    static float srgbToLinear(unsigned char value) {
+        float c = value / 255.0f;
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+
+    static unsigned char linearToSrgb(float value) {
+        float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+        return (unsigned char)std::min(255.0f, std::max(0.0f, c * 255.0f + 0.5f));
+    }
+
+    // Halves an RGBA level with a 2x2 box filter; sRGB color is averaged in linear space
+    // like glGenerateMipmap does for sRGB textures, alpha and linear data are averaged as is
+    static void downsample(const unsigned char* src, int width, int height, unsigned char* dst, int dstWidth, int dstHeight, const float* toLinear, bool srgb) {
+        for (int y = 0; y < dstHeight; y++) {
+            int y0 = std::min(2 * y, height - 1);
+            int y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < dstWidth; x++) {
+                int x0 = std::min(2 * x, width - 1);
+                int x1 = std::min(2 * x + 1, width - 1);
+                const unsigned char* p[4] = {
+                    src + 4 * (y0 * width + x0), src + 4 * (y0 * width + x1),
+                    src + 4 * (y1 * width + x0), src + 4 * (y1 * width + x1)
+                };
+                unsigned char* out = dst + 4 * (y * dstWidth + x);
+                for (int c = 0; c < 4; c++) {
+                    if (srgb && c < 3) {
+                        float sum = toLinear[p[0][c]] + toLinear[p[1][c]] + toLinear[p[2][c]] + toLinear[p[3][c]];
+                        out[c] = linearToSrgb(sum * 0.25f);
+                    } else {
+                        out[c] = (unsigned char)((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+    std::string BakedTexture::bakedPathFor(std::string imageFileName, TextureColorSpace colorSpace,
+                                           BakedTextureFormat format, BlockQuality quality) {
+        static const char* formatNames[4] = {"rgba8", "bc1", "bc3", "bc5"};
+        std::string name = imageFileName + (colorSpace == TEXTURE_COLOR_LINEAR ? ".linear." : ".srgb.");
+        name += format <= BAKED_FORMAT_BC5 ? formatNames[format] : "unknown";
+        name += quality == BLOCK_QUALITY_HIGH ? ".high" : ".fast";
+        return name + ".gpstex";
+    }
+
+    static bool hasTransparency(const unsigned char* pixels, int width, int height) {
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            if (pixels[4 * i + 3] != 255) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Block rows encoded by one item of the decode pool
+    static const int ENCODE_ROWS_PER_TASK = 16;
+
+    // Encodes one RGBA level in the file format, its block rows spread over the decode pool;
+    // RGBA8 levels are stored as they are
+    static std::vector<unsigned char> encodeLevel(const std::vector<unsigned char>& rgba, int width, int height,
+                                                  BakedTextureFormat format, BlockQuality quality) {
+        if (format == BAKED_FORMAT_RGBA8) {
+            return rgba;
+        }
+
+        BlockFormat blockFormat = format == BAKED_FORMAT_BC1 ? BLOCK_BC1 : (format == BAKED_FORMAT_BC3 ? BLOCK_BC3 : BLOCK_BC5);
+        std::vector<unsigned char> encoded(blockCompressedSize(blockFormat, width, height));
+        int blockRows = (height + 3) / 4;
+        size_t taskCount = (size_t)(blockRows + ENCODE_ROWS_PER_TASK - 1) / ENCODE_ROWS_PER_TASK;
+        TextureLoader::instance().parallelFor(taskCount, [&](size_t task) {
+            int firstRow = (int)task * ENCODE_ROWS_PER_TASK;
+            int lastRow = std::min(blockRows, firstRow + ENCODE_ROWS_PER_TASK);
+            compressBlockRows(rgba.data(), width, height, blockFormat, quality, firstRow, lastRow, encoded.data());
+        });
+        return encoded;
+    }
+
+    bool BakedTexture::write(std::string imageFileName, const unsigned char* pixels, int width, int height, int channels,
+                             TextureColorSpace colorSpace, BakedTextureFormat format, BlockQuality quality) {
+        std::vector<unsigned char> expanded;
+        if (channels != 4) {
+            expanded.resize((size_t)width * height * 4);
+            convertToRGBA(pixels, channels, expanded.data(), (size_t)width * height);
+            pixels = expanded.data();
+        }
+
+        BakedTextureHeader header;
+        std::memcpy(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic));
+        header.version = BAKED_TEXTURE_VERSION;
+        header.colorSpace = colorSpace;
+        header.requestedFormat = format;
+        header.quality = quality;
+        header.reserved = 0;
+        if (format == BAKED_FORMAT_BC1 && hasTransparency(pixels, width, height)) {
+            format = BAKED_FORMAT_BC3;
+        }
+        header.format = format;
+        header.width = (uint32_t)width;
+        header.height = (uint32_t)height;
+        if (!sourceStamp(imageFileName, &header.sourceSize, &header.sourceMtime)) {
+            return false;
+        }
+
+        float toLinear[256];
+        for (int i = 0; i < 256; i++) {
+            toLinear[i] = srgbToLinear((unsigned char)i);
+        }
+
+        // BC5 holds two linear channels whatever the role
+        bool srgb = colorSpace == TEXTURE_COLOR_SRGB && format != BAKED_FORMAT_BC5;
+
+        // full chain down to 1x1; the RGBA level is kept to filter the next one from it
+        std::vector<std::vector<unsigned char> > chain;
+        std::vector<BakedTextureLevelRecord> records;
+        std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+        int levelWidth = width;
+        int levelHeight = height;
+        for (;;) {
+            chain.push_back(encodeLevel(level, levelWidth, levelHeight, format, quality));
+
+            BakedTextureLevelRecord record;
+            record.width = (uint32_t)levelWidth;
+            record.height = (uint32_t)levelHeight;
+            record.size = chain.back().size();
+            records.push_back(record);
+            if (levelWidth == 1 && levelHeight == 1) {
+                break;
+            }
+
+            int nextWidth = std::max(1, levelWidth / 2);
+            int nextHeight = std::max(1, levelHeight / 2);
+            std::vector<unsigned char> next((size_t)nextWidth * nextHeight * 4);
+            downsample(level.data(), levelWidth, levelHeight, next.data(), nextWidth, nextHeight, toLinear, srgb);
+            level.swap(next);
+            levelWidth = nextWidth;
+            levelHeight = nextHeight;
+        }
+        header.levelCount = (uint32_t)records.size();
+
+        // RGBA levels and compressed blocks are multiples of 4 bytes, so every level stays 4 byte aligned
+        uint64_t offset = sizeof(header) + records.size() * sizeof(BakedTextureLevelRecord);
+        for (size_t i = 0; i < records.size(); i++) {
+            records[i].offset = offset;
+            offset += records[i].size;
+        }
+
+        // write to a temporary file first so a crash never leaves a truncated file behind
+        // the requested format names the file, so a BC1 bake promoted to BC3 is still found
+        std::string bakedPath = bakedPathFor(imageFileName, colorSpace, (BakedTextureFormat)header.requestedFormat, quality);
+        // unique per process and thread, so concurrent bakes never write the same temporary file
+        std::ostringstream tempName;
+        tempName << bakedPath << "." << getpid() << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".tmp";
+        std::string tempPath = tempName.str();
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            fprintf(stderr, "WARNING: could not write baked texture %s\n", bakedPath.c_str());
+            return false;
+        }
+
+        out.write((const char*)&header, sizeof(header));
+        out.write((const char*)records.data(), records.size() * sizeof(BakedTextureLevelRecord));
+        for (size_t i = 0; i < chain.size(); i++) {
+            out.write((const char*)chain[i].data(), chain[i].size());
+        }
+
+        out.close();
+        if (!out || std::rename(tempPath.c_str(), bakedPath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            fprintf(stderr, "WARNING: could not write baked texture %s\n", bakedPath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool BakedTexture::open(std::string imageFileName, TextureColorSpace colorSpace, BakedTextureFormat format, BlockQuality quality) {
+        close();
+
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        if (!sourceStamp(imageFileName, &sourceSize, &sourceMtime)) {
+            return false;
+        }
+
+        if (!file.open(bakedPathFor(imageFileName, colorSpace, format, quality)) || file.size() < sizeof(BakedTextureHeader)) {
+            close();
+            return false;
+        }
+
+        const BakedTextureHeader* header = (const BakedTextureHeader*)file.data();
+        if (std::memcmp(header->magic, BAKED_TEXTURE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != BAKED_TEXTURE_VERSION ||
+            header->sourceSize != sourceSize ||
+            header->sourceMtime != sourceMtime ||
+            header->colorSpace != (uint32_t)colorSpace ||
+            header->requestedFormat != (uint32_t)format ||
+            header->quality != (uint32_t)quality ||
+            !parse()) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Walks the level table and points every level at its pixels
+    bool BakedTexture::parse() {
+        const char* base = file.data();
+        size_t mappingSize = file.size();
+        const BakedTextureHeader* header = (const BakedTextureHeader*)base;
+        if (header->format > BAKED_FORMAT_BC5 || header->levelCount == 0 || header->levelCount > 32) {
+            return false;
+        }
+        format = (BakedTextureFormat)header->format;
+
+        size_t tableEnd = sizeof(BakedTextureHeader) + header->levelCount * sizeof(BakedTextureLevelRecord);
+        if (tableEnd > mappingSize) {
+            return false;
+        }
+
+        levels.clear();
+        for (uint32_t i = 0; i < header->levelCount; i++) {
+            BakedTextureLevelRecord record;
+            std::memcpy(&record, base + sizeof(BakedTextureHeader) + i * sizeof(record), sizeof(record));
+            if (record.offset + record.size > mappingSize) {
+                return false;
+            }
+
+            BakedTextureLevel level;
+            level.width = record.width;
+            level.height = record.height;
+            level.data = (const unsigned char*)(base + record.offset);
+            level.size = (size_t)record.size;
+            levels.push_back(level);
+        }
+
+        return true;
+    }
+
+    void BakedTexture::close() {
+        file.close();
+        levels.clear();
+    }
+
+    BakedTextureFormat BakedTexture::getFormat() {
+        return format;
+    }
+
+    const std::vector<BakedTextureLevel>& BakedTexture::getLevels() {
+        return levels;
+    }
+
+    size_t BakedTexture::getTotalBytes() {
+        size_t total = 0;
+        for (size_t i = 0; i < levels.size(); i++) {
+            total += levels[i].size;
+        }
+        return total;
+    }
+}
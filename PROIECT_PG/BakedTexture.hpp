@@ -0,0 +1,83 @@
+#ifndef BakedTexture_hpp
+#define BakedTexture_hpp
+
+#include "BlockCompressor.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the on-disk layout changes
+    const uint32_t BAKED_TEXTURE_VERSION = 3;
+
+    // How the data of a texture is interpreted: color maps are sRGB, data maps (specular, ...) are linear
+    enum TextureColorSpace {
+        TEXTURE_COLOR_SRGB = 0,
+        TEXTURE_COLOR_LINEAR = 1
+    };
+
+    // Pixel layout of the levels stored in a baked texture
+    enum BakedTextureFormat {
+        // 8 bit color (sRGB or linear, see TextureColorSpace) + linear alpha, rows flipped for OpenGL
+        BAKED_FORMAT_RGBA8 = 0,
+        // S3TC color (DXT1)
+        BAKED_FORMAT_BC1 = 1,
+        // S3TC color with interpolated alpha (DXT5)
+        BAKED_FORMAT_BC3 = 2,
+        // RGTC red/green pair, linear
+        BAKED_FORMAT_BC5 = 3
+    };
+
+    // One mip level; data points into the mapped file
+    struct BakedTextureLevel {
+        uint32_t width;
+        uint32_t height;
+        const unsigned char* data;
+        size_t size;
+    };
+
+    // KTX-style container next to an image file that holds its final, flipped mip chain,
+    // so the runtime only maps the file and uploads every level as is.
+    class BakedTexture
+    {
+    public:
+        // Returns the path of the baked file that belongs to an image file baked with the given settings;
+        // every combination gets its own file, so one image can be baked for several roles at once
+        static std::string bakedPathFor(std::string imageFileName, TextureColorSpace colorSpace,
+                                        BakedTextureFormat format, BlockQuality quality);
+
+        // Builds the mip chain of flipped pixels (1 to 4 channels, expanded to RGBA), encodes every level
+        // in the given format and writes it next to the image file. BC1 is promoted to BC3 if the image has transparency.
+        // sRGB color is filtered in linear space, linear data as it is.
+        static bool write(std::string imageFileName, const unsigned char* pixels, int width, int height, int channels,
+                          TextureColorSpace colorSpace, BakedTextureFormat format = BAKED_FORMAT_RGBA8,
+                          BlockQuality quality = BLOCK_QUALITY_HIGH);
+
+        // Maps the baked file of an image; fails if it is missing, stale, from another version
+        // or was baked with other settings than the given ones
+        bool open(std::string imageFileName, TextureColorSpace colorSpace, BakedTextureFormat format, BlockQuality quality);
+
+        // Unmaps the file; the levels returned by getLevels() become invalid
+        void close();
+
+        BakedTextureFormat getFormat();
+
+        // Level 0 is the full size image
+        const std::vector<BakedTextureLevel>& getLevels();
+
+        // Sum of the sizes of all levels
+        size_t getTotalBytes();
+
+    private:
+        MappedFile file;
+        BakedTextureFormat format;
+        std::vector<BakedTextureLevel> levels;
+
+        bool parse();
+    };
+}
+
+#endif /* BakedTexture_hpp */
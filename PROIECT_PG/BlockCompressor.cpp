@@ -0,0 +1,319 @@
+#include "BlockCompressor.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    static int expand5(int value) {
+        return (value << 3) | (value >> 2);
+    }
+
+    static int expand6(int value) {
+        return (value << 2) | (value >> 4);
+    }
+
+    static uint16_t packColor(const float* color) {
+        int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+        int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+        int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void unpackColor(uint16_t packed, int* color) {
+        color[0] = expand5((packed >> 11) & 31);
+        color[1] = expand6((packed >> 5) & 63);
+        color[2] = expand5(packed & 31);
+    }
+
+    static void writeU16(unsigned char* out, uint16_t value) {
+        out[0] = (unsigned char)(value & 0xff);
+        out[1] = (unsigned char)(value >> 8);
+    }
+
+    // Per channel minimum and maximum of the 16 RGBA pixels of a block
+    static void blockBounds(const unsigned char* block, unsigned char* minColor, unsigned char* maxColor) {
+#if defined(__SSE2__)
+        __m128i p0 = _mm_loadu_si128((const __m128i*)(block + 0));
+        __m128i p1 = _mm_loadu_si128((const __m128i*)(block + 16));
+        __m128i p2 = _mm_loadu_si128((const __m128i*)(block + 32));
+        __m128i p3 = _mm_loadu_si128((const __m128i*)(block + 48));
+        __m128i lo = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+        __m128i hi = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+        // fold the four pixels of each register into one
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+        lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+        hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+        uint32_t loBits = (uint32_t)_mm_cvtsi128_si32(lo);
+        uint32_t hiBits = (uint32_t)_mm_cvtsi128_si32(hi);
+        std::memcpy(minColor, &loBits, 4);
+        std::memcpy(maxColor, &hiBits, 4);
+#else
+        for (int c = 0; c < 4; c++) {
+            minColor[c] = 255;
+            maxColor[c] = 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                minColor[c] = std::min(minColor[c], block[4 * i + c]);
+                maxColor[c] = std::max(maxColor[c], block[4 * i + c]);
+            }
+        }
+#endif
+    }
+
+    // Picks the nearest of the four palette entries for every pixel; returns the squared error
+    static int selectColorIndices(const unsigned char* block, uint16_t c0, uint16_t c1, uint32_t* indices) {
+        int palette[4][3];
+        unpackColor(c0, palette[0]);
+        unpackColor(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        int error = 0;
+        *indices = 0;
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int dr = block[4 * i + 0] - palette[p][0];
+                int dg = block[4 * i + 1] - palette[p][1];
+                int db = block[4 * i + 2] - palette[p][2];
+                int distance = dr * dr + dg * dg + db * db;
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            error += bestDistance;
+            *indices |= (uint32_t)best << (2 * i);
+        }
+        return error;
+    }
+
+    // Endpoints along the principal axis of the block colors
+    static void principalEndpoints(const unsigned char* block, float* end0, float* end1) {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                mean[c] += block[4 * i + c];
+            }
+        }
+        for (int c = 0; c < 3; c++) {
+            mean[c] /= 16.0f;
+        }
+
+        float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++) {
+            float r = block[4 * i + 0] - mean[0];
+            float g = block[4 * i + 1] - mean[1];
+            float b = block[4 * i + 2] - mean[2];
+            cov[0] += r * r;
+            cov[1] += r * g;
+            cov[2] += r * b;
+            cov[3] += g * g;
+            cov[4] += g * b;
+            cov[5] += b * b;
+        }
+
+        // power iteration for the dominant eigenvector
+        float axis[3] = {1.0f, 1.0f, 1.0f};
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+            float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+            float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+            float length = std::max(std::max(std::abs(x), std::abs(y)), std::abs(z));
+            if (length < 1e-6f) {
+                break;
+            }
+            axis[0] = x / length;
+            axis[1] = y / length;
+            axis[2] = z / length;
+        }
+
+        float minProjection = 1e30f;
+        float maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float projection = (block[4 * i + 0] - mean[0]) * axis[0] +
+                               (block[4 * i + 1] - mean[1]) * axis[1] +
+                               (block[4 * i + 2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+
+        float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        if (axisLengthSquared < 1e-12f) {
+            axisLengthSquared = 1.0f;
+        }
+        for (int c = 0; c < 3; c++) {
+            end0[c] = mean[c] + axis[c] * maxProjection / axisLengthSquared;
+            end1[c] = mean[c] + axis[c] * minProjection / axisLengthSquared;
+        }
+    }
+
+    // Solves for the endpoints that best reproduce the block with the given indices
+    static bool refineEndpoints(const unsigned char* block, uint32_t indices, float* end0, float* end1) {
+        static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+
+        float a = 0.0f, b = 0.0f, c = 0.0f;
+        float x[3] = {0.0f, 0.0f, 0.0f};
+        float y[3] = {0.0f, 0.0f, 0.0f};
+        for (int i = 0; i < 16; i++) {
+            float w = weights[(indices >> (2 * i)) & 3];
+            a += w * w;
+            b += w * (1.0f - w);
+            c += (1.0f - w) * (1.0f - w);
+            for (int k = 0; k < 3; k++) {
+                x[k] += w * block[4 * i + k];
+                y[k] += (1.0f - w) * block[4 * i + k];
+            }
+        }
+
+        float determinant = a * c - b * b;
+        if (std::abs(determinant) < 1e-6f) {
+            return false;
+        }
+        for (int k = 0; k < 3; k++) {
+            end0[k] = (c * x[k] - b * y[k]) / determinant;
+            end1[k] = (a * y[k] - b * x[k]) / determinant;
+        }
+        return true;
+    }
+
+    // Writes an 8 byte BC1 color block, always in four color mode
+    static void encodeColorBlock(const unsigned char* block, BlockQuality quality, unsigned char* out) {
+        float end0[3], end1[3];
+        if (quality == BLOCK_QUALITY_HIGH) {
+            principalEndpoints(block, end0, end1);
+        } else {
+            unsigned char minColor[4], maxColor[4];
+            blockBounds(block, minColor, maxColor);
+            // inset the box a little, the extremes are rarely worth a palette entry
+            for (int c = 0; c < 3; c++) {
+                float inset = (maxColor[c] - minColor[c]) / 16.0f;
+                end0[c] = maxColor[c] - inset;
+                end1[c] = minColor[c] + inset;
+            }
+        }
+
+        uint16_t c0 = packColor(end0);
+        uint16_t c1 = packColor(end1);
+        uint32_t indices = 0;
+        int error = selectColorIndices(block, c0, c1, &indices);
+
+        if (quality == BLOCK_QUALITY_HIGH) {
+            for (int iteration = 0; iteration < 2 && error > 0; iteration++) {
+                float refined0[3], refined1[3];
+                if (!refineEndpoints(block, indices, refined0, refined1)) {
+                    break;
+                }
+                uint16_t r0 = packColor(refined0);
+                uint16_t r1 = packColor(refined1);
+                uint32_t refinedIndices = 0;
+                int refinedError = selectColorIndices(block, r0, r1, &refinedIndices);
+                if (refinedError >= error) {
+                    break;
+                }
+                c0 = r0;
+                c1 = r1;
+                indices = refinedIndices;
+                error = refinedError;
+            }
+        }
+
+        if (c0 < c1) {
+            // four color mode needs c0 > c1: swap the endpoints and remap 0<->1, 2<->3
+            std::swap(c0, c1);
+            indices ^= 0x55555555;
+        } else if (c0 == c1) {
+            indices = 0;
+        }
+
+        writeU16(out, c0);
+        writeU16(out + 2, c1);
+        out[4] = (unsigned char)(indices & 0xff);
+        out[5] = (unsigned char)((indices >> 8) & 0xff);
+        out[6] = (unsigned char)((indices >> 16) & 0xff);
+        out[7] = (unsigned char)(indices >> 24);
+    }
+
+    // Writes an 8 byte BC4 block for one channel of the block (alpha of BC3, each half of BC5)
+    static void encodeChannelBlock(const unsigned char* block, int channel, unsigned char* out) {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++) {
+            lo = std::min(lo, (int)block[4 * i + channel]);
+            hi = std::max(hi, (int)block[4 * i + channel]);
+        }
+
+        out[0] = (unsigned char)hi;
+        out[1] = (unsigned char)lo;
+        uint64_t indices = 0;
+        if (hi > lo) {
+            // eight value mode: 0 = hi, 1 = lo, 2..7 step from hi to lo
+            static const int codeForStep[8] = {0, 2, 3, 4, 5, 6, 7, 1};
+            for (int i = 0; i < 16; i++) {
+                int value = block[4 * i + channel];
+                int step = ((value - hi) * -7 + (hi - lo) / 2) / (hi - lo);
+                step = std::min(7, std::max(0, step));
+                indices |= (uint64_t)codeForStep[step] << (3 * i);
+            }
+        }
+        for (int b = 0; b < 6; b++) {
+            out[2 + b] = (unsigned char)((indices >> (8 * b)) & 0xff);
+        }
+    }
+
+    size_t blockCompressedSize(BlockFormat format, int width, int height) {
+        size_t blocks = (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4);
+        return blocks * (format == BLOCK_BC1 ? 8 : 16);
+    }
+
+    void compressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+                       BlockQuality quality, unsigned char* out) {
+        compressBlockRows(rgba, width, height, format, quality, 0, (height + 3) / 4, out);
+    }
+
+    void compressBlockRows(const unsigned char* rgba, int width, int height, BlockFormat format,
+                           BlockQuality quality, int firstRow, int lastRow, unsigned char* out) {
+        size_t blockBytes = format == BLOCK_BC1 ? 8 : 16;
+        out += (size_t)firstRow * ((width + 3) / 4) * blockBytes;
+        unsigned char block[64];
+        for (int by = 4 * firstRow; by < std::min(height, 4 * lastRow); by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                // gather the 4x4 block, repeating the last row/column at the edges
+                for (int y = 0; y < 4; y++) {
+                    int sy = std::min(by + y, height - 1);
+                    for (int x = 0; x < 4; x++) {
+                        int sx = std::min(bx + x, width - 1);
+                        std::memcpy(block + 4 * (4 * y + x), rgba + 4 * ((size_t)sy * width + sx), 4);
+                    }
+                }
+
+                switch (format) {
+                    case BLOCK_BC1:
+                        encodeColorBlock(block, quality, out);
+                        out += 8;
+                        break;
+                    case BLOCK_BC3:
+                        encodeChannelBlock(block, 3, out);
+                        encodeColorBlock(block, quality, out + 8);
+                        out += 16;
+                        break;
+                    case BLOCK_BC5:
+                        encodeChannelBlock(block, 0, out);
+                        encodeChannelBlock(block, 1, out + 8);
+                        out += 16;
+                        break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef BlockCompressor_hpp
+#define BlockCompressor_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // S3TC/RGTC block formats produced by the bake step
+    enum BlockFormat {
+        // RGB, 8 bytes per 4x4 block
+        BLOCK_BC1,
+        // RGBA with interpolated alpha, 16 bytes per block
+        BLOCK_BC3,
+        // two independent channels (red and green), 16 bytes per block
+        BLOCK_BC5
+    };
+
+    enum BlockQuality {
+        // bounding box endpoints
+        BLOCK_QUALITY_FAST,
+        // principal axis endpoints refined by least squares
+        BLOCK_QUALITY_HIGH
+    };
+
+    // Bytes needed by one w x h level; partial blocks at the edges take a whole block
+    size_t blockCompressedSize(BlockFormat format, int width, int height);
+
+    // Encodes an RGBA8 image; out must hold blockCompressedSize() bytes
+    void compressImage(const unsigned char* rgba, int width, int height, BlockFormat format,
+                       BlockQuality quality, unsigned char* out);
+
+    // Encodes block rows [firstRow, lastRow) of an RGBA8 image, 4 pixel rows each, into their place
+    // in out, which points at the blocks of the whole image. Disjoint ranges can be encoded concurrently.
+    void compressBlockRows(const unsigned char* rgba, int width, int height, BlockFormat format,
+                           BlockQuality quality, int firstRow, int lastRow, unsigned char* out);
+}
+
+#endif /* BlockCompressor_hpp */
@@ -0,0 +1,168 @@
+#include "Bounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#define GPS_BOUNDS_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define GPS_BOUNDS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace gps {
+
+    static inline const float* positionAt(const float* positions, size_t i, size_t stride) {
+        return (const float*)((const char*)positions + i * stride);
+    }
+
+    // Component-wise min/max over all positions
+    static void reduceMinMax(const float* positions, size_t count, size_t stride, glm::vec3* minimum, glm::vec3* maximum) {
+#if GPS_BOUNDS_SSE
+        __m128 lo = _mm_loadu_ps(positions);
+        __m128 hi = lo;
+        for (size_t i = 1; i < count; i++) {
+            __m128 p = _mm_loadu_ps(positionAt(positions, i, stride));
+            lo = _mm_min_ps(lo, p);
+            hi = _mm_max_ps(hi, p);
+        }
+        float l[4], h[4];
+        _mm_storeu_ps(l, lo);
+        _mm_storeu_ps(h, hi);
+        *minimum = glm::vec3(l[0], l[1], l[2]);
+        *maximum = glm::vec3(h[0], h[1], h[2]);
+#elif GPS_BOUNDS_NEON
+        float32x4_t lo = vld1q_f32(positions);
+        float32x4_t hi = lo;
+        for (size_t i = 1; i < count; i++) {
+            float32x4_t p = vld1q_f32(positionAt(positions, i, stride));
+            lo = vminq_f32(lo, p);
+            hi = vmaxq_f32(hi, p);
+        }
+        float l[4], h[4];
+        vst1q_f32(l, lo);
+        vst1q_f32(h, hi);
+        *minimum = glm::vec3(l[0], l[1], l[2]);
+        *maximum = glm::vec3(h[0], h[1], h[2]);
+#else
+        *minimum = glm::vec3(positions[0], positions[1], positions[2]);
+        *maximum = *minimum;
+        for (size_t i = 1; i < count; i++) {
+            const float* p = positionAt(positions, i, stride);
+            glm::vec3 position(p[0], p[1], p[2]);
+            *minimum = glm::min(*minimum, position);
+            *maximum = glm::max(*maximum, position);
+        }
+#endif
+    }
+
+    // Largest squared distance of a position from center
+    static float reduceMaxDistance2(const float* positions, size_t count, size_t stride, glm::vec3 center) {
+#if GPS_BOUNDS_SSE
+        __m128 c = _mm_setr_ps(center.x, center.y, center.z, 0.0f);
+        // the fourth lane belongs to the next attribute and must not count
+        __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+        __m128 best = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i++) {
+            __m128 d = _mm_and_ps(_mm_sub_ps(_mm_loadu_ps(positionAt(positions, i, stride)), c), mask);
+            d = _mm_mul_ps(d, d);
+            // horizontal sum of x, y and z
+            __m128 sum = _mm_add_ps(d, _mm_movehl_ps(d, d));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            best = _mm_max_ss(best, sum);
+        }
+        return _mm_cvtss_f32(best);
+#elif GPS_BOUNDS_NEON
+        float32x4_t c = {center.x, center.y, center.z, 0.0f};
+        uint32x4_t mask = {0xffffffffu, 0xffffffffu, 0xffffffffu, 0u};
+        float best = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            float32x4_t d = vsubq_f32(vld1q_f32(positionAt(positions, i, stride)), c);
+            d = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(d), mask));
+            best = std::max(best, vaddvq_f32(vmulq_f32(d, d)));
+        }
+        return best;
+#else
+        float best = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            const float* p = positionAt(positions, i, stride);
+            glm::vec3 d = glm::vec3(p[0], p[1], p[2]) - center;
+            best = std::max(best, glm::dot(d, d));
+        }
+        return best;
+#endif
+    }
+
+    Bounds computeBounds(const float* positions, size_t count, size_t stride) {
+        Bounds bounds;
+        if (count == 0) {
+            return bounds;
+        }
+
+        reduceMinMax(positions, count, stride, &bounds.min, &bounds.max);
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        // the box center is not the tightest sphere center, but it only costs one more pass
+        bounds.radius = std::sqrt(reduceMaxDistance2(positions, count, stride, bounds.center));
+        bounds.valid = true;
+        return bounds;
+    }
+
+    Bounds mergeBounds(const Bounds& a, const Bounds& b) {
+        if (!a.valid) {
+            return b;
+        }
+        if (!b.valid) {
+            return a;
+        }
+
+        Bounds merged;
+        merged.valid = true;
+        merged.min = glm::min(a.min, b.min);
+        merged.max = glm::max(a.max, b.max);
+
+        glm::vec3 offset = b.center - a.center;
+        float distance = std::sqrt(glm::dot(offset, offset));
+        if (distance + b.radius <= a.radius) {
+            merged.center = a.center;
+            merged.radius = a.radius;
+        } else if (distance + a.radius <= b.radius) {
+            merged.center = b.center;
+            merged.radius = b.radius;
+        } else {
+            merged.radius = (distance + a.radius + b.radius) * 0.5f;
+            merged.center = a.center + offset * ((merged.radius - a.radius) / distance);
+        }
+        return merged;
+    }
+
+    Bounds transformBounds(const Bounds& bounds, const glm::mat4& matrix) {
+        if (!bounds.valid) {
+            return bounds;
+        }
+
+        // Arvo: every output axis takes the smaller and larger product of each input axis
+        Bounds result;
+        result.valid = true;
+        glm::vec3 translation(matrix[3]);
+        result.min = translation;
+        result.max = translation;
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                float a = matrix[column][row] * bounds.min[column];
+                float b = matrix[column][row] * bounds.max[column];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        }
+
+        result.center = glm::vec3(matrix * glm::vec4(bounds.center, 1.0f));
+        float scale2 = 0.0f;
+        for (int column = 0; column < 3; column++) {
+            glm::vec3 axis(matrix[column]);
+            scale2 = std::max(scale2, glm::dot(axis, axis));
+        }
+        result.radius = bounds.radius * std::sqrt(scale2);
+        return result;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef Bounds_hpp
+#define Bounds_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    // Axis aligned box plus bounding sphere of a piece of geometry
+    struct Bounds {
+        glm::vec3 min = glm::vec3(0.0f);
+        glm::vec3 max = glm::vec3(0.0f);
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        // false for geometry without vertices; merging skips empty bounds
+        bool valid = false;
+    };
+
+    // Bounds of count positions, each three floats, stride bytes apart.
+    // The stride must leave at least one readable float after every position; the SIMD
+    // loads read four floats at a time and ignore the last one.
+    Bounds computeBounds(const float* positions, size_t count, size_t stride);
+
+    // Smallest box around both boxes and a sphere around both spheres
+    Bounds mergeBounds(const Bounds& a, const Bounds& b);
+
+    // Bounds of the transformed geometry: the box is refitted around the rotated box,
+    // the sphere radius grows with the largest axis scale
+    Bounds transformBounds(const Bounds& bounds, const glm::mat4& matrix);
+}
+
+#endif /* Bounds_hpp */
@@ -0,0 +1,86 @@
+#ifndef GLHandle_hpp
+#define GLHandle_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    struct BufferDeleter {
+        void operator()(GLuint id) const { glDeleteBuffers(1, &id); }
+    };
+
+    struct VertexArrayDeleter {
+        void operator()(GLuint id) const { glDeleteVertexArrays(1, &id); }
+    };
+
+    struct TextureDeleter {
+        void operator()(GLuint id) const { glDeleteTextures(1, &id); }
+    };
+
+    // Owns one GL object name and deletes it when destroyed.
+    // Move-only, so a name can never be deleted twice through copies.
+    template <typename Deleter>
+    class GLHandle
+    {
+    public:
+        GLHandle() : id(0) {}
+        explicit GLHandle(GLuint id) : id(id) {}
+        ~GLHandle() { reset(); }
+
+        GLHandle(const GLHandle&) = delete;
+        GLHandle& operator=(const GLHandle&) = delete;
+
+        GLHandle(GLHandle&& other) noexcept : id(other.id) { other.id = 0; }
+        GLHandle& operator=(GLHandle&& other) noexcept {
+            if (this != &other) {
+                reset(other.id);
+                other.id = 0;
+            }
+            return *this;
+        }
+
+        GLuint get() const { return id; }
+
+        // Deletes the current object and takes over another name
+        void reset(GLuint newId = 0) {
+            if (id != 0) {
+                Deleter()(id);
+            }
+            id = newId;
+        }
+
+        // Gives up ownership without deleting
+        GLuint release() {
+            GLuint name = id;
+            id = 0;
+            return name;
+        }
+
+    private:
+        GLuint id;
+    };
+
+    typedef GLHandle<BufferDeleter> BufferHandle;
+    typedef GLHandle<VertexArrayDeleter> VertexArrayHandle;
+    typedef GLHandle<TextureDeleter> TextureHandle;
+
+    inline BufferHandle genBuffer() {
+        GLuint id;
+        glGenBuffers(1, &id);
+        return BufferHandle(id);
+    }
+
+    inline VertexArrayHandle genVertexArray() {
+        GLuint id;
+        glGenVertexArrays(1, &id);
+        return VertexArrayHandle(id);
+    }
+
+    inline TextureHandle genTexture() {
+        GLuint id;
+        glGenTextures(1, &id);
+        return TextureHandle(id);
+    }
+}
+
+#endif /* GLHandle_hpp */
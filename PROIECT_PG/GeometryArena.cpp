@@ -0,0 +1,241 @@
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace gps {
+
+    // Default page size; a mesh that does not fit gets a page of its own size
+    static const size_t PAGE_VERTICES = 1 << 18;
+    static const size_t PAGE_INDEX_BYTES = 1 << 22;
+
+    void FreeList::reset(size_t capacity) {
+        ranges.clear();
+        this->capacity = capacity;
+        freeSize = capacity;
+        if (capacity > 0) {
+            ranges[0] = capacity;
+        }
+    }
+
+    bool FreeList::allocate(size_t size, size_t alignment, size_t* offset) {
+        for (std::map<size_t, size_t>::iterator it = ranges.begin(); it != ranges.end(); ++it) {
+            size_t start = (it->first + alignment - 1) / alignment * alignment;
+            size_t end = it->first + it->second;
+            if (start + size > end) {
+                continue;
+            }
+
+            // split the range into the padding in front, the allocation and the tail
+            size_t rangeStart = it->first;
+            ranges.erase(it);
+            if (start > rangeStart) {
+                ranges[rangeStart] = start - rangeStart;
+            }
+            if (start + size < end) {
+                ranges[start + size] = end - (start + size);
+            }
+
+            freeSize -= size;
+            *offset = start;
+            return true;
+        }
+        return false;
+    }
+
+    void FreeList::free(size_t offset, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        freeSize += size;
+
+        std::map<size_t, size_t>::iterator next = ranges.lower_bound(offset);
+        if (next != ranges.end() && offset + size == next->first) {
+            size += next->second;
+            next = ranges.erase(next);
+        }
+        if (next != ranges.begin()) {
+            std::map<size_t, size_t>::iterator previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        ranges[offset] = size;
+    }
+
+    size_t FreeList::getCapacity() {
+        return capacity;
+    }
+
+    size_t FreeList::getFreeSize() {
+        return freeSize;
+    }
+
+    GeometryRange::GeometryRange() : arena(NULL) {}
+
+    GeometryRange::GeometryRange(GeometryArena* arena, const GeometryAllocation& allocation)
+        : arena(arena), allocation(allocation) {}
+
+    GeometryRange::~GeometryRange() {
+        reset();
+    }
+
+    GeometryRange::GeometryRange(GeometryRange&& other) noexcept
+        : arena(other.arena), allocation(other.allocation) {
+        other.arena = NULL;
+    }
+
+    GeometryRange& GeometryRange::operator=(GeometryRange&& other) noexcept {
+        if (this != &other) {
+            reset();
+            arena = other.arena;
+            allocation = other.allocation;
+            other.arena = NULL;
+        }
+        return *this;
+    }
+
+    const GeometryAllocation& GeometryRange::get() const {
+        return allocation;
+    }
+
+    void GeometryRange::reset() {
+        if (arena != NULL) {
+            arena->free(&allocation);
+            arena = NULL;
+        }
+    }
+
+    GeometryArena::GeometryArena(GLsizei stride, AttributeSetup setupAttributes) {
+        this->stride = stride;
+        this->setupAttributes = setupAttributes;
+    }
+
+    void GeometryArena::addPage(size_t vertexCapacity, size_t indexCapacity) {
+        Page page;
+        page.VAO = genVertexArray();
+        page.VBO = genBuffer();
+        page.EBO = genBuffer();
+
+        glBindVertexArray(page.VAO.get());
+        glBindBuffer(GL_ARRAY_BUFFER, page.VBO.get());
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity * stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+        setupAttributes();
+        glBindVertexArray(0);
+
+        page.vertices.reset(vertexCapacity);
+        page.indices.reset(indexCapacity);
+        pages.push_back(std::move(page));
+    }
+
+    GeometryRange GeometryArena::allocate(size_t vertexCount, size_t indexBytes) {
+        GeometryAllocation allocation;
+        allocation.vertexCount = vertexCount;
+        allocation.indexBytes = indexBytes;
+
+        // 32 bit indices have to start on a 4 byte boundary
+        size_t indexSize = (indexBytes + 3) & ~(size_t)3;
+
+        for (size_t attempt = 0; attempt < 2; attempt++) {
+            for (size_t i = 0; i < pages.size(); i++) {
+                Page& page = pages[i];
+                size_t vertexOffset;
+                if (!page.vertices.allocate(vertexCount, 1, &vertexOffset)) {
+                    continue;
+                }
+                size_t indexOffset;
+                if (!page.indices.allocate(indexSize, 4, &indexOffset)) {
+                    page.vertices.free(vertexOffset, vertexCount);
+                    continue;
+                }
+
+                allocation.page = (int)i;
+                allocation.VAO = page.VAO.get();
+                allocation.VBO = page.VBO.get();
+                allocation.EBO = page.EBO.get();
+                allocation.baseVertex = (GLint)vertexOffset;
+                allocation.indexOffset = indexOffset;
+                allocationCount++;
+                return GeometryRange(this, allocation);
+            }
+
+            addPage(std::max(PAGE_VERTICES, vertexCount), std::max(PAGE_INDEX_BYTES, indexSize));
+        }
+
+        return GeometryRange(this, allocation);
+    }
+
+    void GeometryArena::free(GeometryAllocation* allocation) {
+        if (allocation->page < 0 || allocation->page >= (int)pages.size()) {
+            return;
+        }
+
+        Page& page = pages[allocation->page];
+        page.vertices.free((size_t)allocation->baseVertex, allocation->vertexCount);
+        page.indices.free(allocation->indexOffset, (allocation->indexBytes + 3) & ~(size_t)3);
+        allocationCount--;
+        allocation->page = -1;
+    }
+
+    GLsizei GeometryArena::getStride() {
+        return stride;
+    }
+
+    GeometryArenaStats GeometryArena::getStats() {
+        GeometryArenaStats stats;
+        stats.pageCount = pages.size();
+        stats.allocationCount = allocationCount;
+        for (size_t i = 0; i < pages.size(); i++) {
+            Page& page = pages[i];
+            stats.capacityBytes += page.vertices.getCapacity() * stride + page.indices.getCapacity();
+            stats.usedBytes += (page.vertices.getCapacity() - page.vertices.getFreeSize()) * stride
+                + page.indices.getCapacity() - page.indices.getFreeSize();
+        }
+        return stats;
+    }
+
+    void DrawBatch::add(const GeometryAllocation& allocation, GLenum indexType, GLsizei indexCount, size_t firstIndexByte) {
+        if (!counts.empty() && (allocation.VAO != VAO || indexType != this->indexType)) {
+            flush();
+        }
+
+        VAO = allocation.VAO;
+        this->indexType = indexType;
+        counts.push_back(indexCount);
+        offsets.push_back((const GLvoid*)(allocation.indexOffset + firstIndexByte));
+        baseVertices.push_back(allocation.baseVertex);
+    }
+
+    void DrawBatch::flush() {
+        if (counts.empty()) {
+            return;
+        }
+
+        glBindVertexArray(VAO);
+        if (counts.size() == 1) {
+            glDrawElementsBaseVertex(GL_TRIANGLES, counts[0], indexType, offsets[0], baseVertices[0]);
+        } else {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType, offsets.data(),
+                                          (GLsizei)counts.size(), baseVertices.data());
+        }
+        glBindVertexArray(0);
+
+        drawCalls++;
+        rangeCount += counts.size();
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+    }
+
+    size_t DrawBatch::getDrawCalls() {
+        return drawCalls;
+    }
+
+    size_t DrawBatch::getRangeCount() {
+        return rangeCount;
+    }
+}
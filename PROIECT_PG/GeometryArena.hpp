@@ -0,0 +1,146 @@
+#ifndef GeometryArena_hpp
+#define GeometryArena_hpp
+
+#include <GL/glew.h>
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace gps {
+
+    // First-fit allocator over a linear range; freed ranges are merged with their neighbours
+    class FreeList
+    {
+    public:
+        void reset(size_t capacity);
+
+        // Returns false if no free range is large enough
+        bool allocate(size_t size, size_t alignment, size_t* offset);
+
+        void free(size_t offset, size_t size);
+
+        size_t getCapacity();
+        size_t getFreeSize();
+
+    private:
+        // offset -> size of every free range
+        std::map<size_t, size_t> ranges;
+        size_t capacity = 0;
+        size_t freeSize = 0;
+    };
+
+    // A sub-range of one arena page; baseVertex and indexOffset go straight into glDrawElementsBaseVertex
+    struct GeometryAllocation {
+        // -1 when nothing is allocated
+        int page = -1;
+        GLuint VAO = 0;
+        GLuint VBO = 0;
+        GLuint EBO = 0;
+        GLint baseVertex = 0;
+        size_t vertexCount = 0;
+        // byte offset of the first index inside the page EBO
+        size_t indexOffset = 0;
+        size_t indexBytes = 0;
+    };
+
+    class GeometryArena;
+
+    // Owns one allocation and gives it back to its arena when destroyed; move-only
+    class GeometryRange
+    {
+    public:
+        GeometryRange();
+        GeometryRange(GeometryArena* arena, const GeometryAllocation& allocation);
+        ~GeometryRange();
+
+        GeometryRange(const GeometryRange&) = delete;
+        GeometryRange& operator=(const GeometryRange&) = delete;
+        GeometryRange(GeometryRange&& other) noexcept;
+        GeometryRange& operator=(GeometryRange&& other) noexcept;
+
+        const GeometryAllocation& get() const;
+
+        // Frees the range now
+        void reset();
+
+    private:
+        GeometryArena* arena;
+        GeometryAllocation allocation;
+    };
+
+    struct GeometryArenaStats {
+        size_t pageCount = 0;
+        size_t allocationCount = 0;
+        size_t capacityBytes = 0;
+        size_t usedBytes = 0;
+    };
+
+    // Shared vertex/index buffers for every mesh of one vertex layout.
+    // Each page is a large VBO + EBO with a single VAO; meshes get ranges of it and draw
+    // with a base vertex, so consecutive draws need no VAO switch and can be merged.
+    // Must only be used from the thread that owns the GL context.
+    class GeometryArena
+    {
+    public:
+        // Sets the vertex attribute pointers of a page VAO; called with the VAO and VBO bound
+        typedef void (*AttributeSetup)(void);
+
+        GeometryArena(GLsizei stride, AttributeSetup setupAttributes);
+
+        // Finds room for a mesh, adding a page if none of the existing ones has space
+        GeometryRange allocate(size_t vertexCount, size_t indexBytes);
+
+        // Returns the range to the free lists; pages are kept for later meshes.
+        // Called by GeometryRange.
+        void free(GeometryAllocation* allocation);
+
+        GLsizei getStride();
+
+        GeometryArenaStats getStats();
+
+    private:
+        struct Page {
+            VertexArrayHandle VAO;
+            BufferHandle VBO;
+            BufferHandle EBO;
+            FreeList vertices;
+            FreeList indices;
+        };
+
+        GLsizei stride;
+        AttributeSetup setupAttributes;
+        std::vector<Page> pages;
+        size_t allocationCount = 0;
+
+        void addPage(size_t vertexCapacity, size_t indexCapacity);
+    };
+
+    // Merges consecutive draws from the same VAO and index type into one glMultiDrawElementsBaseVertex
+    class DrawBatch
+    {
+    public:
+        // firstIndexByte starts the draw further into the allocation, e.g. at a level of detail
+        void add(const GeometryAllocation& allocation, GLenum indexType, GLsizei indexCount, size_t firstIndexByte = 0);
+
+        // Issues the pending draws
+        void flush();
+
+        // Draws issued by flush() so far, and how many ranges they covered
+        size_t getDrawCalls();
+        size_t getRangeCount();
+
+    private:
+        GLuint VAO = 0;
+        GLenum indexType = 0;
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+        std::vector<GLint> baseVertices;
+        size_t drawCalls = 0;
+        size_t rangeCount = 0;
+    };
+}
+
+#endif /* GeometryArena_hpp */
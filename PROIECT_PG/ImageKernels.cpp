@@ -0,0 +1,228 @@
+#include "ImageKernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GPS_IMAGE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace gps {
+
+    // ---- scalar paths, also the tails of the vector loops ----
+
+    static void swapBytes(unsigned char* a, unsigned char* b, size_t count) {
+        unsigned char temp[256];
+        while (count > 0) {
+            size_t chunk = std::min(count, sizeof(temp));
+            std::memcpy(temp, a, chunk);
+            std::memcpy(a, b, chunk);
+            std::memcpy(b, temp, chunk);
+            a += chunk;
+            b += chunk;
+            count -= chunk;
+        }
+    }
+
+    static void convertToRGBAScalar(const unsigned char* src, int srcChannels, unsigned char* dst, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char* in = src + i * srcChannels;
+            unsigned char* out = dst + i * 4;
+            switch (srcChannels) {
+                case 1: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+                case 2: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+                case 3: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+                default: std::memcpy(out, in, 4); break;
+            }
+        }
+    }
+
+#if GPS_IMAGE_KERNELS_X86
+
+    static void swapRowsSSE2(unsigned char* a, unsigned char* b, size_t count) {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i top = _mm_loadu_si128((const __m128i*)(a + i));
+            __m128i bottom = _mm_loadu_si128((const __m128i*)(b + i));
+            _mm_storeu_si128((__m128i*)(a + i), bottom);
+            _mm_storeu_si128((__m128i*)(b + i), top);
+        }
+        swapBytes(a + i, b + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    static void swapRowsAVX2(unsigned char* a, unsigned char* b, size_t count) {
+        size_t i = 0;
+        for (; i + 64 <= count; i += 64) {
+            __m256i top0 = _mm256_loadu_si256((const __m256i*)(a + i));
+            __m256i top1 = _mm256_loadu_si256((const __m256i*)(a + i + 32));
+            __m256i bottom0 = _mm256_loadu_si256((const __m256i*)(b + i));
+            __m256i bottom1 = _mm256_loadu_si256((const __m256i*)(b + i + 32));
+            _mm256_storeu_si256((__m256i*)(a + i), bottom0);
+            _mm256_storeu_si256((__m256i*)(a + i + 32), bottom1);
+            _mm256_storeu_si256((__m256i*)(b + i), top0);
+            _mm256_storeu_si256((__m256i*)(b + i + 32), top1);
+        }
+        swapRowsSSE2(a + i, b + i, count - i);
+    }
+
+    // 16 grey pixels -> 16 RGBA pixels
+    static size_t greyToRGBASSE2(const unsigned char* src, unsigned char* dst, size_t count) {
+        const __m128i opaque = _mm_set1_epi8((char)0xff);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m128i grey = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i gg0 = _mm_unpacklo_epi8(grey, grey);
+            __m128i gg1 = _mm_unpackhi_epi8(grey, grey);
+            __m128i ga0 = _mm_unpacklo_epi8(grey, opaque);
+            __m128i ga1 = _mm_unpackhi_epi8(grey, opaque);
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 0), _mm_unpacklo_epi16(gg0, ga0));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(gg0, ga0));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_unpacklo_epi16(gg1, ga1));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_unpackhi_epi16(gg1, ga1));
+        }
+        return i;
+    }
+
+    // 8 grey+alpha pixels -> 8 RGBA pixels
+    static size_t greyAlphaToRGBASSE2(const unsigned char* src, unsigned char* dst, size_t count) {
+        const __m128i lowByte = _mm_set1_epi16(0x00ff);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i ga = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+            __m128i g = _mm_and_si128(ga, lowByte);
+            __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 0), _mm_unpacklo_epi16(gg, ga));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(gg, ga));
+        }
+        return i;
+    }
+
+    // 4 RGB pixels -> 4 RGBA pixels per shuffle; the 16 byte load needs 4 bytes of slack after the pixels
+    __attribute__((target("ssse3")))
+    static size_t rgbToRGBASSSE3(const unsigned char* src, unsigned char* dst, size_t count) {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+        size_t i = 0;
+        for (; i + 6 <= count; i += 4) {
+            __m128i rgb = _mm_loadu_si128((const __m128i*)(src + 3 * i));
+            _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+        }
+        return i;
+    }
+
+    static bool hasAVX2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    static bool hasSSSE3() {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+
+#endif
+
+    void flipRowsVertically(unsigned char* pixels, size_t rowBytes, int height) {
+#if GPS_IMAGE_KERNELS_X86
+        void (*swapRows)(unsigned char*, unsigned char*, size_t) = hasAVX2() ? swapRowsAVX2 : swapRowsSSE2;
+#else
+        void (*swapRows)(unsigned char*, unsigned char*, size_t) = swapBytes;
+#endif
+        for (int row = 0; row < height / 2; row++) {
+            swapRows(pixels + row * rowBytes, pixels + (height - row - 1) * rowBytes, rowBytes);
+        }
+    }
+
+    void convertToRGBA(const unsigned char* src, int srcChannels, unsigned char* dst, size_t count) {
+        size_t done = 0;
+#if GPS_IMAGE_KERNELS_X86
+        switch (srcChannels) {
+            case 1: done = greyToRGBASSE2(src, dst, count); break;
+            case 2: done = greyAlphaToRGBASSE2(src, dst, count); break;
+            case 3: done = hasSSSE3() ? rgbToRGBASSSE3(src, dst, count) : 0; break;
+            default: break;
+        }
+#endif
+        convertToRGBAScalar(src + done * srcChannels, srcChannels, dst + done * 4, count - done);
+    }
+
+    const char* imageKernelPath() {
+#if GPS_IMAGE_KERNELS_X86
+        return hasAVX2() ? "AVX2" : "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    // ---- microbenchmark ----
+
+    // The loop texture loading used before the kernels, kept as the baseline
+    static void flipRowsReference(unsigned char* image_data, int width_in_bytes, int y) {
+        unsigned char *top = NULL;
+        unsigned char *bottom = NULL;
+        unsigned char temp = 0;
+        int half_height = y / 2;
+
+        for (int row = 0; row < half_height; row++) {
+            top = image_data + row * width_in_bytes;
+            bottom = image_data + (y - row - 1) * width_in_bytes;
+            for (int col = 0; col < width_in_bytes; col++) {
+                temp = *top;
+                *top = *bottom;
+                *bottom = temp;
+                top++;
+                bottom++;
+            }
+        }
+    }
+
+    template <typename Kernel>
+    static double bytesPerSecond(size_t bytes, Kernel kernel) {
+        const int iterations = 8;
+        kernel();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            kernel();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return bytes * (double)iterations / seconds;
+    }
+
+    static void printResult(const char* name, double before, double after) {
+        std::cout << "  " << name << " : " << before / 1e6 << " MB/s -> " << after / 1e6 << " MB/s ("
+            << after / before << "x)" << std::endl;
+    }
+
+    void benchmarkImageKernels() {
+        const int size = 4096;
+        const size_t pixelCount = (size_t)size * size;
+        std::vector<unsigned char> rgba(pixelCount * 4);
+        std::vector<unsigned char> source(pixelCount * 3);
+        for (size_t i = 0; i < rgba.size(); i++) {
+            rgba[i] = (unsigned char)(i * 31);
+        }
+        for (size_t i = 0; i < source.size(); i++) {
+            source[i] = (unsigned char)(i * 17);
+        }
+
+        std::cout << "Image kernels (" << imageKernelPath() << "), " << size << "x" << size << " pixels:" << std::endl;
+
+        double before = bytesPerSecond(rgba.size(), [&] { flipRowsReference(rgba.data(), size * 4, size); });
+        double after = bytesPerSecond(rgba.size(), [&] { flipRowsVertically(rgba.data(), (size_t)size * 4, size); });
+        printResult("flip RGBA      ", before, after);
+
+        for (int channels = 1; channels <= 3; channels++) {
+            size_t inputBytes = pixelCount * channels;
+            before = bytesPerSecond(inputBytes, [&] { convertToRGBAScalar(source.data(), channels, rgba.data(), pixelCount); });
+            after = bytesPerSecond(inputBytes, [&] { convertToRGBA(source.data(), channels, rgba.data(), pixelCount); });
+            const char* names[4] = {"", "grey -> RGBA   ", "grey+a -> RGBA ", "RGB -> RGBA    "};
+            printResult(names[channels], before, after);
+        }
+    }
+}
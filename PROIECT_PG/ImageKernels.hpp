@@ -0,0 +1,21 @@
+#ifndef ImageKernels_hpp
+#define ImageKernels_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Swaps the rows of an image top to bottom in place; used by every texture decode
+    void flipRowsVertically(unsigned char* pixels, size_t rowBytes, int height);
+
+    // Widens count pixels of 1 (grey), 2 (grey+alpha), 3 (RGB) or 4 channels to RGBA8
+    void convertToRGBA(const unsigned char* src, int srcChannels, unsigned char* dst, size_t count);
+
+    // Name of the instruction set the kernels picked at startup ("AVX2", "SSE2", "scalar")
+    const char* imageKernelPath();
+
+    // Times the kernels against the old byte-by-byte loops on a 4096x4096 image
+    void benchmarkImageKernels();
+}
+
+#endif /* ImageKernels_hpp */
@@ -0,0 +1,57 @@
+#include "MappedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gps {
+
+    MappedFile::MappedFile() : mapping(NULL), mappingSize(0) {}
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    bool MappedFile::open(std::string fileName) {
+        close();
+
+        int fd = ::open(fileName.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void* address = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file alive, the descriptor is no longer needed
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            return false;
+        }
+
+        this->mapping = address;
+        this->mappingSize = (size_t)info.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (this->mapping) {
+            munmap(this->mapping, this->mappingSize);
+        }
+        this->mapping = NULL;
+        this->mappingSize = 0;
+    }
+
+    const char* MappedFile::data() {
+        return (const char*)this->mapping;
+    }
+
+    size_t MappedFile::size() {
+        return this->mappingSize;
+    }
+}
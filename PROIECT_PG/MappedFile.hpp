@@ -0,0 +1,31 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        bool open(std::string fileName);
+        void close();
+
+        const char* data();
+        size_t size();
+
+    private:
+        void* mapping;
+        size_t mappingSize;
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+}
+
+#endif /* MappedFile_hpp */
@@ -1,71 +1,406 @@
 #include "Mesh.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
 namespace gps {
 
+	GLenum indexTypeFor(size_t vertexCount) {
+		return vertexCount <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+
+	size_t indexTypeSize(GLenum indexType) {
+		return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	}
+
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures, VertexFormat format)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->format = format;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+
+		this->setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), GL_UNSIGNED_INT, this->indices.size());
+	}
 
-		this->setupMesh();
+	Mesh::Mesh(const Vertex* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+			   std::vector<Texture> textures, VertexFormat format)
+	{
+		this->format = format;
+		this->textures = std::move(textures);
+
+		// upload from the caller's arrays so mapped data goes to the driver untouched
+		this->setupMesh(vertices, vertexCount, indices, indexType, indexCount);
+	}
+
+	size_t Mesh::keepCpuData(const Vertex* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+							 MeshRetention retention) {
+		if (retention == MESH_RETAIN_NONE) {
+			return 0;
+		}
+
+		if (indexType == GL_UNSIGNED_SHORT) {
+			const GLushort* shortIndices = (const GLushort*)indices;
+			this->indices.assign(shortIndices, shortIndices + indexCount);
+		} else {
+			const GLuint* intIndices = (const GLuint*)indices;
+			this->indices.assign(intIndices, intIndices + indexCount);
+		}
+		if (retention == MESH_RETAIN_POSITIONS) {
+			this->positions.resize(vertexCount);
+			for (size_t i = 0; i < vertexCount; i++) {
+				this->positions[i] = vertices[i].Position;
+			}
+			return this->indices.capacity() * sizeof(GLuint) + this->positions.capacity() * sizeof(glm::vec3);
+		}
+		this->vertices.assign(vertices, vertices + vertexCount);
+		return this->indices.capacity() * sizeof(GLuint) + this->vertices.capacity() * sizeof(Vertex);
+	}
+
+	Mesh::Mesh(BufferHandle VBO, BufferHandle EBO, size_t vertexCount, size_t indexCount, std::vector<Texture> textures,
+			   Bounds bounds, GLenum indexType)
+	{
+		this->format = VERTEX_FORMAT_FLOAT;
+		this->dequantization = glm::mat4(1.0f);
+		this->bounds = bounds;
+		this->textures = std::move(textures);
+		this->indexCount = (GLsizei)indexCount;
+		this->lods.assign(1, MeshLod{0, (GLuint)indexCount, (GLuint)vertexCount, 0.0f});
+
+		size_t indexBytes = indexCount * indexTypeSize(indexType);
+		this->geometry = arenaFor(this->format).allocate(vertexCount, indexBytes);
+		const GeometryAllocation& allocation = this->geometry.get();
+		this->buffers.VAO = allocation.VAO;
+		this->buffers.VBO = allocation.VBO;
+		this->buffers.EBO = allocation.EBO;
+		this->buffers.indexType = indexType;
+
+		// the copy stays on the GPU
+		if (vertexCount > 0 && indexCount > 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, VBO.get());
+			glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.VBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+								allocation.baseVertex * sizeof(Vertex), vertexCount * sizeof(Vertex));
+			glBindBuffer(GL_COPY_READ_BUFFER, EBO.get());
+			glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.EBO);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, allocation.indexOffset, indexBytes);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		// the staging buffers are deleted by their handles
+	}
+
+	// Attribute layouts of the arena pages; the shaders see vec3/vec3/vec2 for both
+	static void setupFloatAttributes() {
+		// Vertex Positions
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		// Vertex Normals
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+		// Vertex Texture Coords
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+	}
+
+	static void setupPackedAttributes() {
+		// the attribute fetch expands the packed values
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+	}
+
+	// Never destroyed: meshes of global models free their ranges during static destruction
+	GeometryArena& Mesh::arenaFor(VertexFormat format) {
+		static GeometryArena* floatArena = new GeometryArena(sizeof(Vertex), setupFloatAttributes);
+		static GeometryArena* packedArena = new GeometryArena(sizeof(PackedVertex), setupPackedAttributes);
+		return format == VERTEX_FORMAT_PACKED ? *packedArena : *floatArena;
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	glm::mat4 Mesh::getDequantization() {
+		return this->dequantization;
+	}
+
+	size_t Mesh::getVertexStride() {
+		return this->format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+	}
+
+	size_t Mesh::getIndexBytes() {
+		return (size_t)this->indexCount * indexTypeSize(this->buffers.indexType);
+	}
+
+	GLsizei Mesh::getIndexCount() {
+		return this->indexCount;
+	}
+
+	void Mesh::setLods(std::vector<MeshLod> lods) {
+		if (lods.empty()) {
+			return;
+		}
+		this->lods = std::move(lods);
+	}
+
+	const std::vector<MeshLod>& Mesh::getLods() {
+		return this->lods;
+	}
+
+	void Mesh::setClusters(std::vector<MeshCluster> clusters) {
+		this->clusters = std::move(clusters);
+	}
+
+	const std::vector<MeshCluster>& Mesh::getClusters() {
+		return this->clusters;
+	}
+
+	Bounds Mesh::getBounds() {
+		return this->bounds;
+	}
+
+	Bounds Mesh::getBounds(glm::mat4 modelMatrix) {
+		return transformBounds(this->bounds, modelMatrix);
+	}
+
+	size_t Mesh::releaseCpuData(MeshRetention retention) {
+		if (retention == MESH_RETAIN_ALL) {
+			return 0;
+		}
+
+		// swapping with an empty vector releases the capacity, clear() would keep it
+		size_t freed = this->vertices.capacity() * sizeof(Vertex);
+		// meshes filled by keepCpuData() already hold just the positions
+		if (retention == MESH_RETAIN_POSITIONS && !this->vertices.empty()) {
+			this->positions.resize(this->vertices.size());
+			for (size_t i = 0; i < this->vertices.size(); i++) {
+				this->positions[i] = this->vertices[i].Position;
+			}
+			freed -= this->positions.capacity() * sizeof(glm::vec3);
+		} else if (retention == MESH_RETAIN_NONE) {
+			freed += this->indices.capacity() * sizeof(GLuint);
+			std::vector<GLuint>().swap(this->indices);
+		}
+		std::vector<Vertex>().swap(this->vertices);
+		return freed;
+	}
+
+	// IEEE half float with round to nearest; tiny values flush to zero
+	static GLushort floatToHalf(float value) {
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if (exponent <= 0) {
+			return (GLushort)sign;
+		}
+		if (exponent >= 31) {
+			// overflow and NaN/inf both end up as inf
+			return (GLushort)(sign | 0x7c00);
+		}
+		uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+		// round to nearest, a carry into the exponent is still correct
+		if (mantissa & 0x1000) {
+			half++;
+		}
+		return (GLushort)half;
+	}
+
+	static GLuint packNormal(glm::vec3 normal) {
+		GLuint packed = 0;
+		for (int c = 0; c < 3; c++) {
+			float component = std::min(1.0f, std::max(-1.0f, normal[c]));
+			int value = (int)std::floor(component * 511.0f + 0.5f);
+			packed |= ((GLuint)value & 0x3ff) << (10 * c);
+		}
+		return packed;
+	}
+
+	// Converts the vertices to the packed layout inside the bounds of the mesh.
+	// One scale for all axes keeps the dequantization uniform, so normal matrices stay valid.
+	static std::vector<PackedVertex> packVertices(const Vertex* vertexData, size_t vertexCount, glm::vec3 minimum, glm::vec3 maximum,
+												  glm::mat4* dequantization) {
+		glm::vec3 extent = maximum - minimum;
+		float scale = std::max(extent.x, std::max(extent.y, extent.z));
+		if (scale <= 0.0f) {
+			scale = 1.0f;
+		}
+
+		std::vector<PackedVertex> packed(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++) {
+			glm::vec3 normalized = (vertexData[i].Position - minimum) / scale;
+			for (int c = 0; c < 3; c++) {
+				packed[i].Position[c] = (GLushort)std::floor(std::min(1.0f, std::max(0.0f, normalized[c])) * 65535.0f + 0.5f);
+			}
+			packed[i].Position[3] = 0;
+			packed[i].Normal = packNormal(vertexData[i].Normal);
+			packed[i].TexCoords[0] = floatToHalf(vertexData[i].TexCoords.x);
+			packed[i].TexCoords[1] = floatToHalf(vertexData[i].TexCoords.y);
+		}
+
+		*dequantization = glm::scale(glm::translate(glm::mat4(1.0f), minimum), glm::vec3(scale));
+		return packed;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader& shader)
 	{
 		shader.useShaderProgram();
 
+		this->bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		const MeshLod& lod = this->lods[0];
+		size_t offset = this->geometry.get().indexOffset + lod.firstIndex * indexTypeSize(this->buffers.indexType);
+		glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, this->buffers.indexType,
+								 (GLvoid*)offset, this->geometry.get().baseVertex);
+		glBindVertexArray(0);
+
+		this->unbindTextures();
+    }
+
+	void Mesh::bindTextures(gps::Shader& shader)
+	{
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
 			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
+			// texture types are only known at run time, hashing them is still far cheaper than a GL lookup
+			shader.setInt(gps::UniformName(this->textures[i].type.c_str()), i);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
+	void Mesh::unbindTextures()
+	{
         for(GLuint i = 0; i < this->textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
+	}
 
-    }
+	void Mesh::addTo(DrawBatch* batch, size_t lod)
+	{
+		const MeshLod& level = this->lods[std::min(lod, this->lods.size() - 1)];
+		batch->add(this->geometry.get(), this->buffers.indexType, level.indexCount,
+				   level.firstIndex * indexTypeSize(this->buffers.indexType));
+	}
+
+	// True if every triangle of the cluster faces away from the eye
+	static bool clusterFacesAway(const MeshCluster& cluster, glm::vec4 eye) {
+		if (cluster.coneCutoff >= 1.0f) {
+			return false;
+		}
+		if (eye.w == 0.0f) {
+			// parallel view rays
+			return glm::dot(glm::vec3(eye), cluster.coneAxis) >= cluster.coneCutoff * glm::length(glm::vec3(eye));
+		}
+		glm::vec3 toCluster = cluster.center - glm::vec3(eye) / eye.w;
+		return glm::dot(toCluster, cluster.coneAxis) >= cluster.coneCutoff * glm::length(toCluster) + cluster.radius;
+	}
+
+	void Mesh::addVisibleClustersTo(DrawBatch* batch, const glm::vec4 planes[6], glm::vec4 eye, CullStats* stats)
+	{
+		size_t indexSize = indexTypeSize(this->buffers.indexType);
+		GLuint runStart = 0;
+		GLuint runCount = 0;
+		for (size_t i = 0; i < this->clusters.size(); i++) {
+			const MeshCluster& cluster = this->clusters[i];
+			stats->clustersTested++;
+
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++) {
+				outside = glm::dot(glm::vec3(planes[p]), cluster.center) + planes[p].w < -cluster.radius;
+			}
+			bool culled = outside || clusterFacesAway(cluster, eye);
+			if (outside) {
+				stats->trianglesFrustumCulled += cluster.indexCount / 3;
+			} else if (culled) {
+				stats->trianglesBackfaceCulled += cluster.indexCount / 3;
+			}
+
+			if (!culled && runCount > 0 && runStart + runCount == cluster.firstIndex) {
+				runCount += cluster.indexCount;
+			} else {
+				if (runCount > 0) {
+					batch->add(this->geometry.get(), this->buffers.indexType, runCount, runStart * indexSize);
+					runCount = 0;
+				}
+				if (!culled) {
+					runStart = cluster.firstIndex;
+					runCount = cluster.indexCount;
+				}
+			}
+			if (!culled) {
+				stats->clustersDrawn++;
+				stats->trianglesDrawn += cluster.indexCount / 3;
+			}
+		}
+		if (runCount > 0) {
+			batch->add(this->geometry.get(), this->buffers.indexType, runCount, runStart * indexSize);
+		}
+	}
+
+	bool Mesh::sharesTexturesWith(const Mesh& other)
+	{
+		if (this->textures.size() != other.textures.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			if (this->textures[i].id != other.textures[i].id || this->textures[i].type != other.textures[i].type) {
+				return false;
+			}
+		}
+		return true;
+	}
 
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
-		// Create buffers/arrays
-		glGenVertexArrays(1, &this->buffers.VAO);
-		glGenBuffers(1, &this->buffers.VBO);
-		glGenBuffers(1, &this->buffers.EBO);
+	void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const void* indexData, GLenum indexDataType, size_t indexCount){
+		this->indexCount = (GLsizei)indexCount;
+		this->lods.assign(1, MeshLod{0, (GLuint)indexCount, (GLuint)vertexCount, 0.0f});
+
+		// Take ranges of the shared buffers
+		this->buffers.indexType = indexTypeFor(vertexCount);
+		size_t indexBytes = indexCount * indexTypeSize(this->buffers.indexType);
+		this->geometry = arenaFor(this->format).allocate(vertexCount, indexBytes);
+		const GeometryAllocation& allocation = this->geometry.get();
+		this->buffers.VAO = allocation.VAO;
+		this->buffers.VBO = allocation.VBO;
+		this->buffers.EBO = allocation.EBO;
 
-		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		this->bounds = computeBounds(&vertexData[0].Position.x, vertexCount, sizeof(Vertex));
+		this->dequantization = glm::mat4(1.0f);
+		if (this->format == VERTEX_FORMAT_PACKED) {
+			std::vector<PackedVertex> packed = packVertices(vertexData, vertexCount, this->bounds.min, this->bounds.max, &this->dequantization);
+			glBufferSubData(GL_ARRAY_BUFFER, allocation.baseVertex * sizeof(PackedVertex), vertexCount * sizeof(PackedVertex), packed.data());
+		} else {
+			glBufferSubData(GL_ARRAY_BUFFER, allocation.baseVertex * sizeof(Vertex), vertexCount * sizeof(Vertex), vertexData);
+		}
 
-		glBindVertexArray(0);
+		// the element binding belongs to the VAO, so fill the EBO through the copy target
+		std::vector<GLushort> shortIndices;
+		if (this->buffers.indexType == GL_UNSIGNED_SHORT && indexDataType == GL_UNSIGNED_INT) {
+			const GLuint* intIndices = (const GLuint*)indexData;
+			shortIndices.assign(intIndices, intIndices + indexCount);
+			indexData = shortIndices.data();
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffers.EBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexBytes, indexData);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
 	}
 }
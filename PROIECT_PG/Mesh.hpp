@@ -5,6 +5,8 @@
 #include "glm/glm.hpp"
 
 #include "Shader.hpp"
+#include "Bounds.hpp"
+#include "GeometryArena.hpp"
 
 #include <string>
 #include <vector>
@@ -19,6 +21,31 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// Packed GPU layout, 16 bytes instead of 32: positions are 16 bit normalized inside the mesh bounds,
+// normals signed 10:10:10 normalized and texture coordinates half floats
+struct PackedVertex
+{
+    GLushort Position[4];
+    GLuint Normal;
+    GLushort TexCoords[2];
+};
+
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_PACKED
+};
+
+// Which CPU copies of the geometry a mesh keeps once it is on the GPU
+enum MeshRetention
+{
+    // free vertices and indices; index count and bounds stay
+    MESH_RETAIN_NONE,
+    // keep positions and indices for picking and collision
+    MESH_RETAIN_POSITIONS,
+    MESH_RETAIN_ALL
+};
+
 struct Texture
 {
     GLuint id;
@@ -34,31 +61,157 @@ struct Material
         glm::vec3 specular;
     };
 
+// Names of the shared arena page the mesh lives in; not owned by the mesh
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, whatever the EBO holds
+    GLenum indexType;
 };
 
+// One level of detail: a range of the mesh index buffer drawn with the same vertices
+struct MeshLod {
+    GLuint firstIndex;
+    GLuint indexCount;
+    // vertices the level still references
+    GLuint vertexCount;
+    // largest distance between this level and the full mesh, in model units
+    float error;
+};
+
+// Run of consecutive triangles of the full detail level, culled as a unit. The sphere bounds the
+// triangles and the cone around coneAxis contains all their normals, both in model space.
+struct MeshCluster {
+    GLuint firstIndex;
+    GLuint indexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    // sine of the cone half angle; 1 when the normals are too spread to all face away at once
+    float coneCutoff;
+};
+
+// Triangles drawn and rejected by the cluster culling of one or more draws
+struct CullStats {
+    size_t clustersTested = 0;
+    size_t clustersDrawn = 0;
+    size_t trianglesDrawn = 0;
+    size_t trianglesFrustumCulled = 0;
+    size_t trianglesBackfaceCulled = 0;
+};
+
+// Range of a mesh that came from one source shape before shapes were merged by material
+struct MeshShape {
+    std::string name;
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLuint firstVertex;
+    GLuint vertexCount;
+};
+
+// Smallest index type that can address vertexCount vertices
+GLenum indexTypeFor(size_t vertexCount);
+
+// Size in bytes of one GL_UNSIGNED_SHORT/GL_UNSIGNED_INT index
+size_t indexTypeSize(GLenum indexType);
+
 class Mesh
 {
 public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
+    // only filled by releaseCpuData(MESH_RETAIN_POSITIONS)
+    std::vector<glm::vec3> positions;
     std::vector<Texture> textures;
 
-	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
+	// The arrays are moved into the mesh; pass them with std::move to avoid copying them
+	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		 VertexFormat format = VERTEX_FORMAT_FLOAT);
+
+	// Uploads straight from existing arrays (e.g. a mapped mesh cache); indexType describes the index array.
+	// vertices and indices stay empty, keepCpuData() fills the copies a retention policy asks for.
+	Mesh(const Vertex* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+		 std::vector<Texture> textures, VertexFormat format = VERTEX_FORMAT_FLOAT);
+
+	// Copies already filled vertex/index buffers into the arena and deletes them; vertices and indices stay empty
+	Mesh(BufferHandle VBO, BufferHandle EBO, size_t vertexCount, size_t indexCount, std::vector<Texture> textures,
+		 Bounds bounds, GLenum indexType = GL_UNSIGNED_INT);
+
+	// A mesh owns its arena range, so it can only be moved
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh(Mesh&&) = default;
+	Mesh& operator=(Mesh&&) = default;
+
+	// Shared geometry buffers of a vertex layout
+	static GeometryArena& arenaFor(VertexFormat format);
 
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	// Maps the packed [0, 1] positions back to model space; identity for float meshes.
+	// It has to be applied to the model matrix the mesh is drawn with.
+	glm::mat4 getDequantization();
+
+	// Bytes per vertex in the vertex buffer
+	size_t getVertexStride();
+
+	// Bytes held by the index buffer
+	size_t getIndexBytes();
+
+	// Indices of all levels together
+	GLsizei getIndexCount();
+
+	// Levels of detail from finest to coarsest; by default one level with every index.
+	// The ranges have to lie inside the uploaded index buffer.
+	void setLods(std::vector<MeshLod> lods);
+	const std::vector<MeshLod>& getLods();
+
+	// Clusters of the full detail level; empty for meshes that are always drawn whole
+	void setClusters(std::vector<MeshCluster> clusters);
+	const std::vector<MeshCluster>& getClusters();
+
+	// Box and sphere around the positions, in model space or transformed by a model matrix
+	Bounds getBounds();
+	Bounds getBounds(glm::mat4 modelMatrix);
+
+	// Copies what the policy keeps out of the arrays the mesh was uploaded from; they only have to
+	// stay valid during the call. Returns the number of bytes copied.
+	size_t keepCpuData(const Vertex* vertices, size_t vertexCount, const void* indices, GLenum indexType, size_t indexCount,
+					   MeshRetention retention);
+
+	// Drops the CPU copies the policy does not keep; returns the number of bytes freed
+	size_t releaseCpuData(MeshRetention retention);
+
+	void Draw(gps::Shader& shader);
+
+	// Pieces of Draw, so a model can bind textures once for a run of meshes and batch their draws
+	void bindTextures(gps::Shader& shader);
+	void unbindTextures();
+	void addTo(DrawBatch* batch, size_t lod = 0);
+
+	// Adds the full detail clusters that are inside the frustum and not facing away from the eye;
+	// runs of surviving clusters go in as one range. planes are the six frustum planes and eye the
+	// camera position (w = 1) or orthographic view direction (w = 0), all in model space.
+	void addVisibleClustersTo(DrawBatch* batch, const glm::vec4 planes[6], glm::vec4 eye, CullStats* stats);
+
+	// True if both meshes bind the same textures
+	bool sharesTexturesWith(const Mesh& other);
 
 private:
     /*  Render data  */
     Buffers buffers;
+    GeometryRange geometry;
+    GLsizei indexCount;
+    VertexFormat format;
+    glm::mat4 dequantization;
+    Bounds bounds;
+    std::vector<MeshLod> lods;
+    std::vector<MeshCluster> clusters;
 
 	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// 32 bit indices are narrowed to 16 bit when the mesh has few enough vertices
+	void setupMesh(const Vertex* vertexData, size_t vertexCount, const void* indexData, GLenum indexDataType, size_t indexCount);
 
 };
 
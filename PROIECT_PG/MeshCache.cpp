@@ -0,0 +1,372 @@
+#include "MeshCache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+namespace gps {
+
+    static const char MESH_CACHE_MAGIC[4] = {'G', 'P', 'S', 'M'};
+
+    struct MeshCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        // stamp of the source .obj; a mismatch invalidates the cache
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        // material libraries stamped after the header, before the first mesh
+        uint32_t libraryCount;
+    };
+
+    struct MeshCacheRecord {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexType;
+        uint32_t textureCount;
+        uint32_t lodCount;
+        uint32_t shapeCount;
+        uint32_t clusterCount;
+        float material[9];
+    };
+
+    // Every block in the file starts on a 4 byte boundary so the arrays can be used in place
+    static size_t alignUp(size_t offset) {
+        return (offset + 3) & ~(size_t)3;
+    }
+
+    static bool sourceStamp(std::string fileName, uint64_t* size, int64_t* mtime) {
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+        *size = (uint64_t)info.st_size;
+        *mtime = (int64_t)info.st_mtime;
+        return true;
+    }
+
+    // Like sourceStamp, but a missing file gets a stamp of its own, so creating it later invalidates the cache too
+    static void libraryStamp(std::string fileName, uint64_t* size, int64_t* mtime) {
+        if (!sourceStamp(fileName, size, mtime)) {
+            *size = UINT64_MAX;
+            *mtime = -1;
+        }
+    }
+
+    static inline bool isBlank(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    // Paths of the .mtl files named by the mtllib lines of an .obj, resolved like tinyobj::MaterialFileReader does
+    static std::vector<std::string> materialLibrariesOf(std::string objFileName) {
+        std::vector<std::string> libraries;
+        MappedFile obj;
+        if (!obj.open(objFileName)) {
+            return libraries;
+        }
+
+        size_t slash = objFileName.find_last_of('/');
+        std::string basePath = slash == std::string::npos ? "" : objFileName.substr(0, slash + 1);
+        const char* p = obj.data();
+        const char* end = p + obj.size();
+        while (p < end) {
+            while (p < end && isBlank(*p)) {
+                p++;
+            }
+            const char* next = (const char*)std::memchr(p, '\n', end - p);
+            const char* line = next != NULL ? next : end;
+            if (line - p > 7 && std::strncmp(p, "mtllib", 6) == 0 && isBlank(p[6])) {
+                const char* name = p + 7;
+                while (name < line && isBlank(*name)) {
+                    name++;
+                }
+                const char* nameEnd = name;
+                while (nameEnd < line && !isBlank(*nameEnd) && *nameEnd != '\r') {
+                    nameEnd++;
+                }
+                if (nameEnd > name) {
+                    libraries.push_back(basePath + std::string(name, nameEnd));
+                }
+            }
+            p = next != NULL ? next + 1 : end;
+        }
+        return libraries;
+    }
+
+    static void writePadding(std::ofstream& out) {
+        static const char zeros[4] = {0, 0, 0, 0};
+        size_t position = (size_t)out.tellp();
+        out.write(zeros, alignUp(position) - position);
+    }
+
+    static void writeString(std::ofstream& out, const std::string& value) {
+        uint32_t length = (uint32_t)value.size();
+        out.write((const char*)&length, sizeof(length));
+        out.write(value.data(), length);
+    }
+
+    std::string MeshCache::cachePathFor(std::string objFileName) {
+        return objFileName + ".meshcache";
+    }
+
+    bool MeshCache::write(std::string objFileName, const std::vector<CachedMesh>& meshes) {
+        // zeroed so the padding after libraryCount is written deterministically
+        MeshCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = (uint32_t)meshes.size();
+        if (!sourceStamp(objFileName, &header.sourceSize, &header.sourceMtime)) {
+            return false;
+        }
+        // materials and texture paths come from the .mtl files, so they are stamped as well
+        std::vector<std::string> libraries = materialLibrariesOf(objFileName);
+        header.libraryCount = (uint32_t)libraries.size();
+
+        // write to a temporary file first so a crash never leaves a truncated cache behind
+        std::string cachePath = cachePathFor(objFileName);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            fprintf(stderr, "WARNING: could not write mesh cache %s\n", cachePath.c_str());
+            return false;
+        }
+
+        out.write((const char*)&header, sizeof(header));
+        for (size_t i = 0; i < libraries.size(); i++) {
+            uint64_t size;
+            int64_t mtime;
+            libraryStamp(libraries[i], &size, &mtime);
+            writeString(out, libraries[i]);
+            out.write((const char*)&size, sizeof(size));
+            out.write((const char*)&mtime, sizeof(mtime));
+        }
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const CachedMesh& mesh = meshes[i];
+
+            MeshCacheRecord record;
+            record.vertexCount = mesh.vertexCount;
+            record.indexCount = mesh.indexCount;
+            record.indexType = mesh.indexType;
+            record.textureCount = (uint32_t)mesh.textures.size();
+            record.lodCount = (uint32_t)mesh.lods.size();
+            record.shapeCount = (uint32_t)mesh.shapes.size();
+            record.clusterCount = (uint32_t)mesh.clusters.size();
+            std::memcpy(&record.material[0], &mesh.material.ambient, sizeof(glm::vec3));
+            std::memcpy(&record.material[3], &mesh.material.diffuse, sizeof(glm::vec3));
+            std::memcpy(&record.material[6], &mesh.material.specular, sizeof(glm::vec3));
+            out.write((const char*)&record, sizeof(record));
+
+            for (size_t t = 0; t < mesh.textures.size(); t++) {
+                writeString(out, mesh.textures[t].type);
+                writeString(out, mesh.textures[t].path);
+            }
+            out.write((const char*)mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod));
+            for (size_t s = 0; s < mesh.shapes.size(); s++) {
+                const MeshShape& shape = mesh.shapes[s];
+                writeString(out, shape.name);
+                uint32_t ranges[4] = {shape.firstIndex, shape.indexCount, shape.firstVertex, shape.vertexCount};
+                out.write((const char*)ranges, sizeof(ranges));
+            }
+            out.write((const char*)mesh.clusters.data(), mesh.clusters.size() * sizeof(MeshCluster));
+
+            writePadding(out);
+            out.write((const char*)mesh.vertices, mesh.vertexCount * sizeof(Vertex));
+            out.write((const char*)mesh.indices, mesh.indexCount * indexTypeSize(mesh.indexType));
+        }
+
+        out.close();
+        if (!out || std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            fprintf(stderr, "WARNING: could not write mesh cache %s\n", cachePath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool MeshCache::open(std::string objFileName) {
+        close();
+
+        uint64_t sourceSize;
+        int64_t sourceMtime;
+        if (!sourceStamp(objFileName, &sourceSize, &sourceMtime)) {
+            return false;
+        }
+
+        if (!file.open(cachePathFor(objFileName)) || file.size() < sizeof(MeshCacheHeader)) {
+            close();
+            return false;
+        }
+
+        const MeshCacheHeader* header = (const MeshCacheHeader*)file.data();
+        if (std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != MESH_CACHE_VERSION ||
+            header->vertexSize != sizeof(Vertex) ||
+            header->sourceSize != sourceSize ||
+            header->sourceMtime != sourceMtime ||
+            !parse()) {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Walks the mapped file and points every CachedMesh at its arrays
+    bool MeshCache::parse() {
+        const char* base = file.data();
+        size_t mappingSize = file.size();
+        const MeshCacheHeader* header = (const MeshCacheHeader*)base;
+        size_t offset = sizeof(MeshCacheHeader);
+
+        for (uint32_t i = 0; i < header->libraryCount; i++) {
+            uint32_t length;
+            if (offset + sizeof(length) > mappingSize) {
+                return false;
+            }
+            std::memcpy(&length, base + offset, sizeof(length));
+            offset += sizeof(length);
+            uint64_t size;
+            int64_t mtime;
+            if (offset + length + sizeof(size) + sizeof(mtime) > mappingSize) {
+                return false;
+            }
+            std::string library(base + offset, length);
+            offset += length;
+            std::memcpy(&size, base + offset, sizeof(size));
+            offset += sizeof(size);
+            std::memcpy(&mtime, base + offset, sizeof(mtime));
+            offset += sizeof(mtime);
+
+            // an edited .mtl changes materials and textures the meshes were written with
+            uint64_t currentSize;
+            int64_t currentMtime;
+            libraryStamp(library, &currentSize, &currentMtime);
+            if (currentSize != size || currentMtime != mtime) {
+                return false;
+            }
+        }
+
+        meshes.clear();
+        meshes.reserve(header->meshCount);
+        for (uint32_t i = 0; i < header->meshCount; i++) {
+            if (offset + sizeof(MeshCacheRecord) > mappingSize) {
+                return false;
+            }
+            MeshCacheRecord record;
+            std::memcpy(&record, base + offset, sizeof(record));
+            offset += sizeof(record);
+
+            CachedMesh mesh;
+            mesh.vertexCount = record.vertexCount;
+            mesh.indexCount = record.indexCount;
+            mesh.indexType = record.indexType;
+            if (mesh.indexType != GL_UNSIGNED_SHORT && mesh.indexType != GL_UNSIGNED_INT) {
+                return false;
+            }
+            mesh.material.ambient = glm::vec3(record.material[0], record.material[1], record.material[2]);
+            mesh.material.diffuse = glm::vec3(record.material[3], record.material[4], record.material[5]);
+            mesh.material.specular = glm::vec3(record.material[6], record.material[7], record.material[8]);
+
+            for (uint32_t t = 0; t < record.textureCount; t++) {
+                std::string fields[2];
+                for (int f = 0; f < 2; f++) {
+                    uint32_t length;
+                    if (offset + sizeof(length) > mappingSize) {
+                        return false;
+                    }
+                    std::memcpy(&length, base + offset, sizeof(length));
+                    offset += sizeof(length);
+                    if (offset + length > mappingSize) {
+                        return false;
+                    }
+                    fields[f].assign(base + offset, length);
+                    offset += length;
+                }
+
+                Texture texture;
+                texture.id = 0;
+                texture.type = fields[0];
+                texture.path = fields[1];
+                mesh.textures.push_back(texture);
+            }
+
+            if (offset + (size_t)record.lodCount * sizeof(MeshLod) > mappingSize) {
+                return false;
+            }
+            mesh.lods.resize(record.lodCount);
+            std::memcpy(mesh.lods.data(), base + offset, record.lodCount * sizeof(MeshLod));
+            offset += record.lodCount * sizeof(MeshLod);
+            for (uint32_t l = 0; l < record.lodCount; l++) {
+                if ((uint64_t)mesh.lods[l].firstIndex + mesh.lods[l].indexCount > mesh.indexCount) {
+                    return false;
+                }
+            }
+
+            for (uint32_t s = 0; s < record.shapeCount; s++) {
+                uint32_t length;
+                uint32_t ranges[4];
+                if (offset + sizeof(length) > mappingSize) {
+                    return false;
+                }
+                std::memcpy(&length, base + offset, sizeof(length));
+                offset += sizeof(length);
+                if (offset + length + sizeof(ranges) > mappingSize) {
+                    return false;
+                }
+                MeshShape shape;
+                shape.name.assign(base + offset, length);
+                offset += length;
+                std::memcpy(ranges, base + offset, sizeof(ranges));
+                offset += sizeof(ranges);
+                shape.firstIndex = ranges[0];
+                shape.indexCount = ranges[1];
+                shape.firstVertex = ranges[2];
+                shape.vertexCount = ranges[3];
+                mesh.shapes.push_back(shape);
+            }
+
+            if (offset + (size_t)record.clusterCount * sizeof(MeshCluster) > mappingSize) {
+                return false;
+            }
+            mesh.clusters.resize(record.clusterCount);
+            std::memcpy(mesh.clusters.data(), base + offset, record.clusterCount * sizeof(MeshCluster));
+            offset += record.clusterCount * sizeof(MeshCluster);
+            for (uint32_t c = 0; c < record.clusterCount; c++) {
+                if ((uint64_t)mesh.clusters[c].firstIndex + mesh.clusters[c].indexCount > mesh.indexCount) {
+                    return false;
+                }
+            }
+
+            offset = alignUp(offset);
+            size_t vertexBytes = (size_t)mesh.vertexCount * sizeof(Vertex);
+            size_t indexBytes = (size_t)mesh.indexCount * indexTypeSize(mesh.indexType);
+            if (offset + vertexBytes + indexBytes > mappingSize) {
+                return false;
+            }
+            mesh.vertices = (const Vertex*)(base + offset);
+            offset += vertexBytes;
+            mesh.indices = base + offset;
+            offset += indexBytes;
+
+            meshes.push_back(mesh);
+        }
+
+        return true;
+    }
+
+    void MeshCache::close() {
+        file.close();
+        meshes.clear();
+    }
+
+    const std::vector<CachedMesh>& MeshCache::getMeshes() {
+        return meshes;
+    }
+}
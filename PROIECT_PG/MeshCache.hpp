@@ -0,0 +1,61 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the on-disk layout or gps::Vertex changes
+    const uint32_t MESH_CACHE_VERSION = 7;
+
+    // One mesh as stored in the cache; the arrays point into the mapped file
+    struct CachedMesh {
+        const Vertex* vertices;
+        uint32_t vertexCount;
+        // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT elements, see indexType
+        const void* indices;
+        uint32_t indexCount;
+        GLenum indexType;
+        Material material;
+        // only type and path are meaningful, the GL id is resolved by the loader
+        std::vector<Texture> textures;
+        // ranges of the index array; may be empty for a single level
+        std::vector<MeshLod> lods;
+        // source shapes merged into the mesh
+        std::vector<MeshShape> shapes;
+        // culling clusters of the first level
+        std::vector<MeshCluster> clusters;
+    };
+
+    class MeshCache
+    {
+    public:
+        // Returns the path of the cache file that belongs to an .obj file
+        static std::string cachePathFor(std::string objFileName);
+
+        // Serializes the final meshes of an .obj file next to it, stamped with the .obj and its .mtl files
+        static bool write(std::string objFileName, const std::vector<CachedMesh>& meshes);
+
+        // Maps the cache of an .obj file; fails if it is missing, older than the .obj or one of its .mtl files,
+        // or from another version
+        bool open(std::string objFileName);
+
+        // Unmaps the file; the arrays returned by getMeshes() become invalid
+        void close();
+
+        const std::vector<CachedMesh>& getMeshes();
+
+    private:
+        MappedFile file;
+        std::vector<CachedMesh> meshes;
+
+        bool parse();
+    };
+}
+
+#endif /* MeshCache_hpp */
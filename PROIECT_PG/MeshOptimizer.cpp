@@ -0,0 +1,667 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    VertexCacheStats analyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount,
+                                        unsigned int cacheSize) {
+        // a vertex is in the cache if it was pushed less than cacheSize misses ago
+        std::vector<size_t> pushedAt(vertexCount, 0);
+        size_t misses = 0;
+        std::vector<bool> used(vertexCount, false);
+        size_t usedCount = 0;
+
+        for (size_t i = 0; i < indexCount; i++) {
+            GLuint v = indices[i];
+            if (pushedAt[v] == 0 || misses + 1 - pushedAt[v] > cacheSize) {
+                misses++;
+                pushedAt[v] = misses;
+            }
+            if (!used[v]) {
+                used[v] = true;
+                usedCount++;
+            }
+        }
+
+        VertexCacheStats stats;
+        stats.acmr = indexCount == 0 ? 0.0f : (float)misses / (indexCount / 3);
+        stats.atvr = usedCount == 0 ? 0.0f : (float)misses / usedCount;
+        return stats;
+    }
+
+    void optimizeVertexCache(GLuint* destination, const GLuint* indices, size_t indexCount, size_t vertexCount,
+                             unsigned int cacheSize) {
+        size_t triangleCount = indexCount / 3;
+
+        // vertex -> triangles adjacency in one flat array
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++) {
+            liveTriangles[indices[i]]++;
+        }
+        std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+        }
+        std::vector<unsigned int> adjacency(indexCount);
+        std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[indices[3 * t + k]]++] = (unsigned int)t;
+            }
+        }
+
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<GLuint> deadEnd;
+        std::vector<GLuint> candidates;
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;
+        size_t outputCount = 0;
+
+        long fanning = vertexCount > 0 ? 0 : -1;
+        while (fanning >= 0) {
+            candidates.clear();
+
+            // emit every remaining triangle around the fanning vertex
+            for (size_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++) {
+                unsigned int t = adjacency[a];
+                if (emitted[t]) {
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    GLuint v = indices[3 * t + k];
+                    destination[outputCount++] = v;
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = time++;
+                    }
+                }
+                emitted[t] = true;
+            }
+
+            // next fanning vertex: the candidate that is still in cache after its own fan is emitted
+            long best = -1;
+            size_t bestPriority = 0;
+            for (size_t c = 0; c < candidates.size(); c++) {
+                GLuint v = candidates[c];
+                if (liveTriangles[v] == 0) {
+                    continue;
+                }
+                size_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                    priority = time - cacheTime[v];
+                }
+                if (best < 0 || priority > bestPriority) {
+                    best = v;
+                    bestPriority = priority;
+                }
+            }
+
+            if (best < 0) {
+                // dead end: go back through recently used vertices, then scan in input order
+                while (!deadEnd.empty() && best < 0) {
+                    GLuint v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveTriangles[v] > 0) {
+                        best = v;
+                    }
+                }
+                while (best < 0 && cursor < vertexCount) {
+                    if (liveTriangles[cursor] > 0) {
+                        best = (long)cursor;
+                    }
+                    cursor++;
+                }
+            }
+            fanning = best;
+        }
+    }
+
+    void optimizeOverdraw(GLuint* destination, const GLuint* indices, size_t indexCount,
+                          const Vertex* vertices, size_t vertexCount, float threshold,
+                          unsigned int cacheSize) {
+        size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        // cache misses of every triangle in the current order
+        std::vector<unsigned int> triangleMisses(triangleCount);
+        {
+            std::vector<size_t> pushedAt(vertexCount, 0);
+            size_t misses = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                unsigned int triangleMiss = 0;
+                for (int k = 0; k < 3; k++) {
+                    GLuint v = indices[3 * t + k];
+                    if (pushedAt[v] == 0 || misses + 1 - pushedAt[v] > cacheSize) {
+                        pushedAt[v] = ++misses;
+                        triangleMiss++;
+                    }
+                }
+                triangleMisses[t] = triangleMiss;
+            }
+        }
+
+        // hard boundaries: triangles that start from a cold cache, where Tipsify restarted
+        std::vector<size_t> hardClusters;
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (t == 0 || triangleMisses[t] == 3) {
+                hardClusters.push_back(t);
+            }
+        }
+        hardClusters.push_back(triangleCount);
+
+        // soft boundaries: split a hard cluster wherever restarting costs little extra ACMR
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h + 1 < hardClusters.size(); h++) {
+            size_t start = hardClusters[h];
+            size_t end = hardClusters[h + 1];
+            size_t clusterMisses = 0;
+            for (size_t t = start; t < end; t++) {
+                clusterMisses += triangleMisses[t];
+            }
+            float clusterACMR = (float)clusterMisses / (end - start);
+
+            clusters.push_back(start);
+            size_t runningMisses = 0;
+            size_t runningTriangles = 0;
+            for (size_t t = start; t < end; t++) {
+                runningMisses += triangleMisses[t];
+                runningTriangles++;
+                if (t + 1 < end && triangleMisses[t + 1] >= 2 &&
+                    (float)runningMisses / runningTriangles <= clusterACMR * threshold) {
+                    clusters.push_back(t + 1);
+                    runningMisses = 0;
+                    runningTriangles = 0;
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        // mesh centroid from triangle centers
+        glm::vec3 meshCentroid(0.0f);
+        for (size_t t = 0; t < triangleCount; t++) {
+            meshCentroid += vertices[indices[3 * t]].Position + vertices[indices[3 * t + 1]].Position + vertices[indices[3 * t + 2]].Position;
+        }
+        meshCentroid /= (float)(3 * triangleCount);
+
+        // clusters facing away from the center occlude the others, so they are drawn first
+        size_t clusterCount = clusters.size() - 1;
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+                glm::vec3 p0 = vertices[indices[3 * t]].Position;
+                glm::vec3 p1 = vertices[indices[3 * t + 1]].Position;
+                glm::vec3 p2 = vertices[indices[3 * t + 2]].Position;
+                glm::vec3 weightedNormal = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(weightedNormal);
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += weightedNormal;
+                area += triangleArea;
+            }
+            centroid = area > 0.0f ? centroid / area : vertices[indices[3 * clusters[c]]].Position;
+            float normalLength = glm::length(normal);
+            normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+            sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+        }
+
+        std::vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++) {
+            order[c] = c;
+        }
+        std::stable_sort(order.begin(), order.end(), [&sortKey](size_t a, size_t b) {
+            return sortKey[a] > sortKey[b];
+        });
+
+        size_t outputCount = 0;
+        for (size_t o = 0; o < clusterCount; o++) {
+            size_t c = order[o];
+            for (size_t i = 3 * clusters[c]; i < 3 * clusters[c + 1]; i++) {
+                destination[outputCount++] = indices[i];
+            }
+        }
+    }
+
+    size_t optimizeVertexFetch(Vertex* destination, GLuint* indices, size_t indexCount,
+                               const Vertex* vertices, size_t vertexCount) {
+        const GLuint unassigned = (GLuint)-1;
+        std::vector<GLuint> remap(vertexCount, unassigned);
+        size_t nextVertex = 0;
+
+        for (size_t i = 0; i < indexCount; i++) {
+            GLuint v = indices[i];
+            if (remap[v] == unassigned) {
+                remap[v] = (GLuint)nextVertex;
+                destination[nextVertex++] = vertices[v];
+            }
+            indices[i] = remap[v];
+        }
+
+        return nextVertex;
+    }
+
+    // Symmetric 4x4 error quadric of a set of weighted planes; error(p) = p'Ap + 2b'p + c.
+    // weight is the sum of the plane weights, so the error can be brought back to a squared distance.
+    struct Quadric {
+        double a00, a11, a22, a01, a02, a12;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    static void addPlane(Quadric* q, glm::vec3 normal, float d, double weight) {
+        double x = normal.x, y = normal.y, z = normal.z;
+        q->a00 += weight * x * x; q->a11 += weight * y * y; q->a22 += weight * z * z;
+        q->a01 += weight * x * y; q->a02 += weight * x * z; q->a12 += weight * y * z;
+        q->b0 += weight * x * d; q->b1 += weight * y * d; q->b2 += weight * z * d;
+        q->c += weight * (double)d * d;
+        q->weight += weight;
+    }
+
+    static void addQuadric(Quadric* q, const Quadric& other) {
+        q->a00 += other.a00; q->a11 += other.a11; q->a22 += other.a22;
+        q->a01 += other.a01; q->a02 += other.a02; q->a12 += other.a12;
+        q->b0 += other.b0; q->b1 += other.b1; q->b2 += other.b2;
+        q->c += other.c;
+        q->weight += other.weight;
+    }
+
+    // Weighted mean of the squared distances from p to the planes, in squared model units
+    static double quadricError(const Quadric& q, glm::vec3 p) {
+        if (q.weight <= 0.0) {
+            return 0.0;
+        }
+        double x = p.x, y = p.y, z = p.z;
+        double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z
+            + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z)
+            + 2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+        return std::max(error, 0.0) / q.weight;
+    }
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t words[3];
+            std::memcpy(words, &p, sizeof(words));
+            return ((size_t)words[0] * 73856093u) ^ ((size_t)words[1] * 19349663u) ^ ((size_t)words[2] * 83492791u);
+        }
+    };
+
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double cost;
+    };
+
+    size_t simplifyMesh(GLuint* destination, const GLuint* indices, size_t indexCount,
+                        const Vertex* vertices, size_t vertexCount,
+                        size_t targetIndexCount, float targetError, float* resultError) {
+        std::vector<GLuint> result(indices, indices + indexCount);
+        double maxError = 0.0;
+
+        // vertices that share a position (attribute seams) collapse as one, so they are locked
+        std::unordered_map<glm::vec3, GLuint, PositionHash> firstAtPosition;
+        std::vector<GLuint> positionId(vertexCount);
+        std::vector<unsigned char> locked(vertexCount, 0);
+        std::vector<GLuint> sharedCount(vertexCount, 0);
+        glm::vec3 minimum(0.0f), maximum(0.0f);
+        for (size_t v = 0; v < vertexCount; v++) {
+            auto inserted = firstAtPosition.emplace(vertices[v].Position, (GLuint)v);
+            positionId[v] = inserted.first->second;
+            sharedCount[positionId[v]]++;
+            minimum = v == 0 ? vertices[v].Position : glm::min(minimum, vertices[v].Position);
+            maximum = v == 0 ? vertices[v].Position : glm::max(maximum, vertices[v].Position);
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            if (sharedCount[positionId[v]] > 1) {
+                locked[v] = 1;
+            }
+        }
+
+        // an edge between two positions used by a single triangle lies on an open border
+        std::unordered_map<uint64_t, int> edgeUse;
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            for (int e = 0; e < 3; e++) {
+                GLuint a = positionId[indices[i + e]];
+                GLuint b = positionId[indices[i + (e + 1) % 3]];
+                uint64_t key = a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+                edgeUse[key]++;
+            }
+        }
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            for (int e = 0; e < 3; e++) {
+                GLuint a = indices[i + e];
+                GLuint b = indices[i + (e + 1) % 3];
+                GLuint pa = positionId[a], pb = positionId[b];
+                uint64_t key = pa < pb ? ((uint64_t)pa << 32) | pb : ((uint64_t)pb << 32) | pa;
+                if (edgeUse[key] != 2) {
+                    locked[a] = 1;
+                    locked[b] = 1;
+                }
+            }
+        }
+
+        // every vertex starts with the area weighted planes of its triangles; quadricError divides the
+        // area back out, so the costs stay squared distances whatever the scale of the model
+        std::vector<Quadric> quadrics(vertexCount);
+        std::memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            glm::vec3 p0 = vertices[indices[i]].Position;
+            glm::vec3 p1 = vertices[indices[i + 1]].Position;
+            glm::vec3 p2 = vertices[indices[i + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = std::sqrt(glm::dot(normal, normal));
+            if (length <= 0.0f) {
+                continue;
+            }
+            normal /= length;
+            float d = -glm::dot(normal, p0);
+            for (int k = 0; k < 3; k++) {
+                addPlane(&quadrics[indices[i + k]], normal, d, 0.5 * length);
+            }
+        }
+
+        // the costs are squared distances, so the limit distance is squared as well
+        glm::vec3 extent = maximum - minimum;
+        double errorLimit = (double)targetError * std::max(extent.x, std::max(extent.y, extent.z));
+        errorLimit *= errorLimit;
+
+        std::vector<GLuint> remap(vertexCount);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<size_t> adjacencyStart(vertexCount + 1);
+        std::vector<size_t> adjacency;
+        std::vector<Collapse> collapses;
+
+        while (result.size() > targetIndexCount) {
+            size_t triangleCount = result.size() / 3;
+
+            // vertex -> triangles of this pass
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+            for (size_t i = 0; i < result.size(); i++) {
+                adjacencyStart[result[i] + 1]++;
+            }
+            for (size_t v = 0; v < vertexCount; v++) {
+                adjacencyStart[v + 1] += adjacencyStart[v];
+            }
+            adjacency.resize(result.size());
+            std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int k = 0; k < 3; k++) {
+                    adjacency[fill[result[3 * t + k]]++] = t;
+                }
+            }
+
+            collapses.clear();
+            for (size_t t = 0; t < triangleCount; t++) {
+                for (int e = 0; e < 3; e++) {
+                    GLuint a = result[3 * t + e];
+                    GLuint b = result[3 * t + (e + 1) % 3];
+                    for (int direction = 0; direction < 2; direction++) {
+                        GLuint from = direction == 0 ? a : b;
+                        GLuint to = direction == 0 ? b : a;
+                        if (locked[from]) {
+                            continue;
+                        }
+                        Quadric combined = quadrics[from];
+                        addQuadric(&combined, quadrics[to]);
+                        Collapse collapse = {from, to, quadricError(combined, vertices[to].Position)};
+                        if (collapse.cost <= errorLimit) {
+                            collapses.push_back(collapse);
+                        }
+                    }
+                }
+            }
+            if (collapses.empty()) {
+                break;
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+                return x.cost < y.cost;
+            });
+
+            // each collapse removes about two triangles
+            size_t wanted = (result.size() - targetIndexCount) / 6 + 1;
+            size_t applied = 0;
+            for (size_t v = 0; v < vertexCount; v++) {
+                remap[v] = (GLuint)v;
+            }
+            std::fill(touched.begin(), touched.end(), 0);
+
+            for (size_t c = 0; c < collapses.size() && applied < wanted; c++) {
+                const Collapse& collapse = collapses[c];
+                if (touched[collapse.from] || touched[collapse.to]) {
+                    continue;
+                }
+
+                // reject the collapse if any surviving triangle around `from` turns over
+                bool flips = false;
+                glm::vec3 target = vertices[collapse.to].Position;
+                for (size_t k = adjacencyStart[collapse.from]; k < adjacencyStart[collapse.from + 1] && !flips; k++) {
+                    size_t t = adjacency[k];
+                    GLuint corners[3] = {remap[result[3 * t]], remap[result[3 * t + 1]], remap[result[3 * t + 2]]};
+                    if (corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+                        continue;
+                    }
+                    glm::vec3 before[3], after[3];
+                    for (int j = 0; j < 3; j++) {
+                        before[j] = vertices[corners[j]].Position;
+                        after[j] = corners[j] == collapse.from ? target : before[j];
+                    }
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    float lengths = std::sqrt(glm::dot(normalBefore, normalBefore) * glm::dot(normalAfter, normalAfter));
+                    flips = glm::dot(normalBefore, normalAfter) <= 0.25f * lengths;
+                }
+                if (flips) {
+                    continue;
+                }
+
+                remap[collapse.from] = collapse.to;
+                addQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+                maxError = std::max(maxError, collapse.cost);
+                // the neighbourhood changed, so nothing around it moves again in this pass
+                for (size_t k = adjacencyStart[collapse.from]; k < adjacencyStart[collapse.from + 1]; k++) {
+                    size_t t = adjacency[k];
+                    for (int j = 0; j < 3; j++) {
+                        touched[result[3 * t + j]] = 1;
+                    }
+                }
+                applied++;
+            }
+            if (applied == 0) {
+                break;
+            }
+
+            // rewrite the triangles and drop the ones that collapsed to a line
+            size_t write = 0;
+            for (size_t t = 0; t < triangleCount; t++) {
+                GLuint a = remap[result[3 * t]];
+                GLuint b = remap[result[3 * t + 1]];
+                GLuint c = remap[result[3 * t + 2]];
+                if (a == b || b == c || a == c) {
+                    continue;
+                }
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        std::copy(result.begin(), result.end(), destination);
+        if (resultError != NULL) {
+            *resultError = (float)std::sqrt(maxError);
+        }
+        return result.size();
+    }
+
+    // Sphere and normal cone of triangles [first, last) of a list
+    static MeshCluster makeCluster(const GLuint* indices, size_t first, size_t last, const Vertex* vertices) {
+        MeshCluster cluster;
+        cluster.firstIndex = (GLuint)first;
+        cluster.indexCount = (GLuint)(last - first);
+
+        glm::vec3 minimum = vertices[indices[first]].Position, maximum = minimum;
+        for (size_t i = first; i < last; i++) {
+            minimum = glm::min(minimum, vertices[indices[i]].Position);
+            maximum = glm::max(maximum, vertices[indices[i]].Position);
+        }
+        cluster.center = (minimum + maximum) * 0.5f;
+        cluster.radius = 0.0f;
+        for (size_t i = first; i < last; i++) {
+            glm::vec3 offset = vertices[indices[i]].Position - cluster.center;
+            cluster.radius = std::max(cluster.radius, glm::dot(offset, offset));
+        }
+        cluster.radius = std::sqrt(cluster.radius);
+
+        // the cone axis is the mean face normal; the widest normal sets its angle
+        std::vector<glm::vec3> normals;
+        glm::vec3 axis(0.0f);
+        for (size_t i = first; i + 2 < last; i += 3) {
+            glm::vec3 p0 = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+            float length = std::sqrt(glm::dot(normal, normal));
+            if (length > 0.0f) {
+                normals.push_back(normal / length);
+                axis += normal / length;
+            }
+        }
+        float axisLength = std::sqrt(glm::dot(axis, axis));
+        cluster.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+        float minimumDot = axisLength > 0.0f ? 1.0f : -1.0f;
+        for (size_t i = 0; i < normals.size(); i++) {
+            minimumDot = std::min(minimumDot, glm::dot(normals[i], cluster.coneAxis));
+        }
+        cluster.coneCutoff = minimumDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+        return cluster;
+    }
+
+    void buildClusters(std::vector<MeshCluster>* clusters, GLuint* indices, size_t firstIndex, size_t indexCount,
+                       const Vertex* vertices, size_t vertexCount, size_t maxVertices, size_t maxTriangles) {
+        GLuint* range = indices + firstIndex;
+        size_t triangleCount = indexCount / 3;
+
+        // vertex -> triangles
+        std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacencyStart[range[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] += adjacencyStart[v];
+        }
+        std::vector<size_t> adjacency(triangleCount * 3);
+        std::vector<size_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int k = 0; k < 3; k++) {
+                adjacency[fill[range[3 * t + k]]++] = t;
+            }
+        }
+
+        std::vector<GLuint> ordered;
+        ordered.reserve(triangleCount * 3);
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        // number of the cluster that last used a vertex
+        std::vector<size_t> lastCluster(vertexCount, (size_t)-1);
+        std::vector<size_t> candidates;
+        size_t seed = 0;
+
+        for (size_t cluster = 0; ordered.size() < triangleCount * 3; cluster++) {
+            // clusters start at the first triangle left in the incoming order
+            while (emitted[seed]) {
+                seed++;
+            }
+            size_t clusterStart = ordered.size();
+            size_t clusterVertices = 0;
+            glm::vec3 origin = vertices[range[3 * seed]].Position;
+            size_t next = seed;
+
+            while (true) {
+                emitted[next] = 1;
+                for (int k = 0; k < 3; k++) {
+                    GLuint v = range[3 * next + k];
+                    ordered.push_back(v);
+                    if (lastCluster[v] != cluster) {
+                        lastCluster[v] = cluster;
+                        clusterVertices++;
+                        for (size_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++) {
+                            if (!emitted[adjacency[a]]) {
+                                candidates.push_back(adjacency[a]);
+                            }
+                        }
+                    }
+                }
+                if ((ordered.size() - clusterStart) / 3 >= maxTriangles) {
+                    break;
+                }
+
+                // grow with the neighbour that adds the fewest vertices, then the one closest to the start
+                size_t best = (size_t)-1;
+                size_t bestNew = 4;
+                float bestDistance = 0.0f;
+                size_t write = 0;
+                for (size_t c = 0; c < candidates.size(); c++) {
+                    size_t t = candidates[c];
+                    if (emitted[t]) {
+                        continue;
+                    }
+                    candidates[write++] = t;
+
+                    GLuint a = range[3 * t], b = range[3 * t + 1], d = range[3 * t + 2];
+                    size_t newVertices = (lastCluster[a] != cluster) + (lastCluster[b] != cluster && b != a)
+                        + (lastCluster[d] != cluster && d != a && d != b);
+                    if (clusterVertices + newVertices > maxVertices) {
+                        continue;
+                    }
+                    glm::vec3 offset = (vertices[a].Position + vertices[b].Position + vertices[d].Position) / 3.0f - origin;
+                    float distance = glm::dot(offset, offset);
+                    if (newVertices < bestNew || (newVertices == bestNew && distance < bestDistance)) {
+                        best = t;
+                        bestNew = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+                candidates.resize(write);
+                if (best == (size_t)-1) {
+                    break;
+                }
+                next = best;
+            }
+
+            candidates.clear();
+
+            // the greedy growth order is poor for the vertex cache, so the cluster is reordered on its own
+            // with its vertices renumbered from zero
+            std::vector<GLuint> localVertices;
+            std::vector<GLuint> localIndices(ordered.size() - clusterStart);
+            for (size_t i = clusterStart; i < ordered.size(); i++) {
+                size_t slot = std::find(localVertices.begin(), localVertices.end(), ordered[i]) - localVertices.begin();
+                if (slot == localVertices.size()) {
+                    localVertices.push_back(ordered[i]);
+                }
+                localIndices[i - clusterStart] = (GLuint)slot;
+            }
+            std::vector<GLuint> localOrder(localIndices.size());
+            optimizeVertexCache(localOrder.data(), localIndices.data(), localIndices.size(), localVertices.size());
+            for (size_t i = 0; i < localOrder.size(); i++) {
+                ordered[clusterStart + i] = localVertices[localOrder[i]];
+            }
+
+            clusters->push_back(makeCluster(ordered.data(), clusterStart, ordered.size(), vertices));
+            clusters->back().firstIndex += (GLuint)firstIndex;
+        }
+
+        std::copy(ordered.begin(), ordered.end(), range);
+    }
+}
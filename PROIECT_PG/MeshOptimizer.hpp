@@ -0,0 +1,60 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Size of the FIFO post-transform cache the passes optimize for and the analysis simulates
+    const unsigned int VERTEX_CACHE_SIZE = 16;
+
+    struct VertexCacheStats {
+        // average cache miss ratio: transformed vertices per triangle (0.5 is ideal, 3 is worst)
+        float acmr;
+        // average transformed vertices per vertex (1 is ideal)
+        float atvr;
+    };
+
+    // Simulates a FIFO vertex cache over a triangle list
+    VertexCacheStats analyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount,
+                                        unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Reorders triangles for the post-transform cache (Tipsify, Sander et al. 2007).
+    // destination must hold indexCount indices and may not alias indices.
+    void optimizeVertexCache(GLuint* destination, const GLuint* indices, size_t indexCount, size_t vertexCount,
+                             unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Splits a cache-optimized triangle list into clusters, allowing the ACMR to grow by at most
+    // threshold, and sorts the clusters so outward facing ones are drawn first to reduce overdraw.
+    // destination must hold indexCount indices and may not alias indices.
+    void optimizeOverdraw(GLuint* destination, const GLuint* indices, size_t indexCount,
+                          const Vertex* vertices, size_t vertexCount, float threshold = 1.05f,
+                          unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+    // Stores the vertices in the order the indices first use them and remaps the indices in place.
+    // Unreferenced vertices are dropped; returns the new vertex count.
+    size_t optimizeVertexFetch(Vertex* destination, GLuint* indices, size_t indexCount,
+                               const Vertex* vertices, size_t vertexCount);
+
+    // Reorders the triangles of indices[firstIndex, firstIndex + indexCount) into clusters of at
+    // most maxVertices distinct vertices and maxTriangles triangles, grown greedily from the first
+    // triangle left so each cluster stays compact, and appends their bounding spheres and normal cones.
+    void buildClusters(std::vector<MeshCluster>* clusters, GLuint* indices, size_t firstIndex, size_t indexCount,
+                       const Vertex* vertices, size_t vertexCount, size_t maxVertices, size_t maxTriangles);
+
+    // Quadric error metric edge collapse (Garland and Heckbert 1997) that only removes vertices,
+    // so the result indexes the same vertex array. Collapses run cheapest first until the triangle
+    // list is down to targetIndexCount or the next collapse would move the surface by more than
+    // targetError times the mesh extent. Border and attribute seam vertices stay in place and
+    // collapses that would flip a triangle are skipped.
+    // destination must hold indexCount indices and may alias indices. Returns the new index count;
+    // resultError receives the largest surface deviation in model units.
+    size_t simplifyMesh(GLuint* destination, const GLuint* indices, size_t indexCount,
+                        const Vertex* vertices, size_t vertexCount,
+                        size_t targetIndexCount, float targetError, float* resultError);
+}
+
+#endif /* MeshOptimizer_hpp */
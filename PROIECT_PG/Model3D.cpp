@@ -1,36 +1,383 @@
 #include "Model3D.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "ObjLoader.hpp"
+#include "ResidentMemory.hpp"
+#include "TextureCache.hpp"
+#include "UniformRing.hpp"
+
+#include "glm/gtc/matrix_inverse.hpp"
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include <utility>
 
 namespace gps {
 
+	// Hashes the raw bits of a vertex so identical face corners collapse into one entry
+	struct VertexHash {
+		size_t operator()(const gps::Vertex& vertex) const {
+			const uint32_t* words = reinterpret_cast<const uint32_t*>(&vertex);
+			size_t hash = 2166136261u;
+			for (size_t i = 0; i < sizeof(gps::Vertex) / sizeof(uint32_t); i++) {
+				hash = (hash ^ words[i]) * 16777619u;
+			}
+			return hash;
+		}
+	};
+
+	struct VertexEqual {
+		bool operator()(const gps::Vertex& a, const gps::Vertex& b) const {
+			return std::memcmp(&a, &b, sizeof(gps::Vertex)) == 0;
+		}
+	};
+
+	typedef std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual> VertexMap;
+
+	// Approximate heap footprint of a VertexMap, used for the peak load memory estimate
+	static size_t vertexMapBytes(const VertexMap& map) {
+		return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(gps::Vertex) + sizeof(GLuint) + 2 * sizeof(void*));
+	}
+
+	// Assembles the interleaved vertex referenced by one face corner
+	static gps::Vertex readVertex(const tinyobj::attrib_t& attrib, tinyobj::index_t idx) {
+		gps::Vertex vertex;
+		vertex.Position = glm::vec3(attrib.vertices[3 * idx.vertex_index + 0],
+									attrib.vertices[3 * idx.vertex_index + 1],
+									attrib.vertices[3 * idx.vertex_index + 2]);
+		vertex.Normal = glm::vec3(0.0f);
+		if (idx.normal_index != -1) {
+			vertex.Normal = glm::vec3(attrib.normals[3 * idx.normal_index + 0],
+									  attrib.normals[3 * idx.normal_index + 1],
+									  attrib.normals[3 * idx.normal_index + 2]);
+		}
+		vertex.TexCoords = glm::vec2(0.0f);
+		if (idx.texcoord_index != -1) {
+			vertex.TexCoords = glm::vec2(attrib.texcoords[2 * idx.texcoord_index + 0],
+										 attrib.texcoords[2 * idx.texcoord_index + 1]);
+		}
+		return vertex;
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		if (!ReadCache(fileName)) {
+			if (loadMode == MODEL_LOAD_STREAMING) {
+				// streamed chunks are copied into the float arena as they are, they are never quantized
+				if (vertexFormat != VERTEX_FORMAT_FLOAT) {
+					std::cerr << "WARNING: " << fileName << " is streamed, packed vertices are not supported; using float vertices" << std::endl;
+					vertexFormat = VERTEX_FORMAT_FLOAT;
+				}
+				ReadOBJStreaming(fileName, basePath);
+			} else {
+				ReadOBJ(fileName, basePath);
+				WriteCache(fileName);
+			}
+		}
+
+		bounds = gps::Bounds();
+		for (size_t i = 0; i < meshes.size(); i++) {
+			bounds = gps::mergeBounds(bounds, meshes[i].getBounds());
+
+			const std::vector<gps::MeshLod>& lods = meshes[i].getLods();
+			for (size_t l = 0; l < lods.size(); l++) {
+				if (stats.lodTriangleCounts.size() <= l) {
+					stats.lodTriangleCounts.push_back(0);
+					stats.lodVertexCounts.push_back(0);
+				}
+				stats.lodTriangleCounts[l] += lods[l].indexCount / 3;
+				stats.lodVertexCounts[l] += lods[l].vertexCount;
+			}
+			stats.clusterCount += meshes[i].getClusters().size();
+		}
+		meshLods.assign(meshes.size(), 0);
+
+		ReleaseCpuData();
+		PrintStats();
+	}
+
+	void Model3D::setLoadMode(ModelLoadMode mode) {
+		this->loadMode = mode;
+	}
+
+	void Model3D::setVertexFormat(VertexFormat format) {
+		this->vertexFormat = format;
+	}
+
+	void Model3D::setRetention(MeshRetention retention) {
+		this->retention = retention;
+	}
+
+	size_t Model3D::getMeshCount() {
+		return meshes.size();
+	}
+
+	const std::vector<gps::MeshShape>& Model3D::getMeshShapes(size_t mesh) {
+		return meshShapes.at(mesh);
+	}
+
+	bool Model3D::findShape(std::string name, size_t* mesh, gps::MeshShape* shape) {
+		for (size_t i = 0; i < meshShapes.size(); i++) {
+			for (size_t j = 0; j < meshShapes[i].size(); j++) {
+				if (meshShapes[i][j].name == name) {
+					*mesh = i;
+					*shape = meshShapes[i][j];
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	void Model3D::setForcedLod(int lod) {
+		this->forcedLod = lod;
+	}
+
+	void Model3D::ReleaseCpuData() {
+		stats.residentBytesBeforeRelease = gps::residentMemoryBytes();
+		for (size_t i = 0; i < meshes.size(); i++) {
+			stats.releasedBytes += meshes[i].releaseCpuData(retention);
+		}
+		stats.residentBytesAfterRelease = gps::residentMemoryBytes();
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	// Runs of meshes with the same textures share one texture bind and, when they sit in the
+	// same arena page, one glMultiDrawElementsBaseVertex call.
+	void Model3D::Draw(gps::Shader& shaderProgram)
+	{
+		shaderProgram.useShaderProgram();
+
+		gps::DrawBatch batch;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (i == 0 || !meshes[i].sharesTexturesWith(meshes[i - 1])) {
+				batch.flush();
+				if (i > 0) {
+					meshes[i - 1].unbindTextures();
+				}
+				meshes[i].bindTextures(shaderProgram);
+			}
+			meshes[i].addTo(&batch, forcedLod >= 0 ? (size_t)forcedLod : 0);
+		}
+		batch.flush();
+		if (!meshes.empty()) {
+			meshes.back().unbindTextures();
+		}
+	}
+
+	void Model3D::Draw(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view)
+	{
+		std::vector<size_t> levels(meshes.size(), forcedLod >= 0 ? (size_t)forcedLod : 0);
+		DrawMeshes(shaderProgram, modelMatrix, view, levels, NULL, NULL);
+	}
+
+	// Switching to a coarser level needs its error this far below the limit, going back to a finer
+	// one needs the current error this far above it
+	static const float LOD_HYSTERESIS = 1.25f;
+
+	void Model3D::Draw(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view, const LodSelection& selection,
+					   const CullView* cullView, gps::CullStats* cullStats)
+	{
+		if (forcedLod >= 0) {
+			std::vector<size_t> levels(meshes.size(), (size_t)forcedLod);
+			DrawMeshes(shaderProgram, modelMatrix, view, levels, cullView, cullStats);
+			return;
+		}
+
+		// the simplification errors are in model units
+		float modelScale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+									std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const std::vector<gps::MeshLod>& lods = meshes[i].getLods();
+			gps::Bounds meshBounds = meshes[i].getBounds(modelMatrix);
+			float distance = glm::length(meshBounds.center - selection.cameraPosition) - meshBounds.radius;
+			// inside the bounding sphere only the full mesh is safe
+			if (distance <= 0.0f) {
+				meshLods[i] = 0;
+				continue;
+			}
+
+			float pixelsPerUnit = modelScale * selection.projectionScale / distance;
+			size_t current = std::min(meshLods[i], lods.size() - 1);
+			size_t level = current;
+			if (lods[current].error * pixelsPerUnit > selection.pixelError * LOD_HYSTERESIS) {
+				level = 0;
+				while (level + 1 < current && lods[level + 1].error * pixelsPerUnit <= selection.pixelError) {
+					level++;
+				}
+			} else {
+				while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit <= selection.pixelError / LOD_HYSTERESIS) {
+					level++;
+				}
+			}
+			meshLods[i] = level;
+		}
+
+		DrawMeshes(shaderProgram, modelMatrix, view, meshLods, cullView, cullStats);
+	}
+
+	static constexpr gps::UniformName MODEL_UNIFORM("model");
+
+	// Frustum planes of a clip matrix (Gribb and Hartmann), normalized so the distances are in its input units
+	static void extractFrustumPlanes(glm::mat4 clip, glm::vec4 planes[6]) {
+		glm::vec4 rows[4];
+		for (int r = 0; r < 4; r++) {
+			rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+		}
+		for (int axis = 0; axis < 3; axis++) {
+			planes[2 * axis] = rows[3] + rows[axis];
+			planes[2 * axis + 1] = rows[3] - rows[axis];
+		}
+		for (int p = 0; p < 6; p++) {
+			planes[p] /= glm::length(glm::vec3(planes[p]));
+		}
+	}
+
+	void Model3D::DrawMeshes(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view, const std::vector<size_t>& levels,
+							 const CullView* cullView, gps::CullStats* cullStats)
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		shaderProgram.useShaderProgram();
+
+		// the cluster bounds are in model space, so the view is brought there instead
+		glm::vec4 planes[6];
+		glm::vec4 eye;
+		gps::CullStats ignoredStats;
+		if (cullView != NULL) {
+			extractFrustumPlanes(cullView->viewProjection * modelMatrix, planes);
+			eye = glm::inverse(modelMatrix) * cullView->eye;
+			if (cullStats == NULL) {
+				cullStats = &ignoredStats;
+			}
+		}
+
+		// Programs with the DrawUniforms block read transform and material from the uniform ring.
+		// The records of all meshes are written first, so the model costs one upload at most;
+		// meshes with the same record share it and stay in one batch.
+		gps::UniformRing& ring = gps::UniformRing::instance();
+		bool drawBlock = ring.isCreated() && shaderProgram.hasUniformBlock(gps::DRAW_UNIFORM_BINDING);
+		size_t drawCount = meshes.size();
+		if (drawBlock) {
+			drawOffsets.resize(meshes.size());
+			// view space, like the plain normalMatrix uniform
+			glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(view * modelMatrix));
+			gps::DrawUniforms previous;
+			for (size_t i = 0; i < meshes.size(); i++) {
+				gps::DrawUniforms draw;
+				draw.model = modelMatrix * meshes[i].getDequantization();
+				for (int c = 0; c < 3; c++) {
+					draw.normalMatrix[c] = glm::vec4(normalMatrix[c], 0.0f);
+				}
+				draw.ambient = glm::vec4(meshMaterials[i].ambient, 1.0f);
+				draw.diffuse = glm::vec4(meshMaterials[i].diffuse, 1.0f);
+				draw.specular = glm::vec4(meshMaterials[i].specular, 1.0f);
+				if (i > 0 && std::memcmp(&draw, &previous, sizeof(draw)) == 0) {
+					drawOffsets[i] = drawOffsets[i - 1];
+					continue;
+				}
+
+				void* record = ring.allocate(sizeof(draw), &drawOffsets[i]);
+				if (record == NULL) {
+					// the ring is full for this frame. The program has no plain model uniform to fall
+					// back to, and the bound range belongs to another draw, so the rest is skipped.
+					drawCount = i;
+					ring.dropDraws(meshes.size() - i);
+					break;
+				}
+				std::memcpy(record, &draw, sizeof(draw));
+				previous = draw;
+			}
+			ring.flush();
+		}
+
+		gps::DrawBatch batch;
+		for (size_t i = 0; i < drawCount; i++) {
+			bool newTextures = i == 0 || !meshes[i].sharesTexturesWith(meshes[i - 1]);
+			bool newModel = drawBlock ? i == 0 || drawOffsets[i] != drawOffsets[i - 1]
+				: i == 0 || meshes[i].getDequantization() != meshes[i - 1].getDequantization();
+			if (newTextures || newModel) {
+				batch.flush();
+			}
+			if (newModel && drawBlock) {
+				ring.bindRange(gps::DRAW_UNIFORM_BINDING, drawOffsets[i], sizeof(gps::DrawUniforms));
+			} else if (newModel) {
+				glm::mat4 meshModel = modelMatrix * meshes[i].getDequantization();
+				shaderProgram.setMat4(MODEL_UNIFORM, meshModel);
+			}
+			if (newTextures) {
+				if (i > 0) {
+					meshes[i - 1].unbindTextures();
+				}
+				meshes[i].bindTextures(shaderProgram);
+			}
+			if (cullView == NULL) {
+				meshes[i].addTo(&batch, levels[i]);
+				continue;
+			}
+
+			const std::vector<gps::MeshLod>& lods = meshes[i].getLods();
+			size_t triangleCount = lods[std::min(levels[i], lods.size() - 1)].indexCount / 3;
+			gps::Bounds meshBounds = meshes[i].getBounds();
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++) {
+				outside = glm::dot(glm::vec3(planes[p]), meshBounds.center) + planes[p].w < -meshBounds.radius;
+			}
+			if (outside) {
+				cullStats->trianglesFrustumCulled += triangleCount;
+			} else if (levels[i] == 0 && !meshes[i].getClusters().empty()) {
+				meshes[i].addVisibleClustersTo(&batch, planes, eye, cullStats);
+			} else {
+				meshes[i].addTo(&batch, levels[i]);
+				cullStats->trianglesDrawn += triangleCount;
+			}
+		}
+		batch.flush();
+		if (drawCount > 0) {
+			meshes[drawCount - 1].unbindTextures();
+		}
 	}
 
-	// Does the parsing of the .obj file and fills in the data structure
+	ModelStats Model3D::getStats() {
+		return this->stats;
+	}
+
+	gps::Bounds Model3D::getBounds() {
+		return this->bounds;
+	}
+
+	gps::Bounds Model3D::getBounds(glm::mat4 modelMatrix) {
+		return gps::transformBounds(this->bounds, modelMatrix);
+	}
+
+	// Merged meshes stay addressable with 16 bit indices unless a single shape is larger
+	static const size_t MERGED_MESH_MAX_VERTICES = 65536;
+
+	// Does the parsing of the .obj file and fills in the data structure.
+	// Shapes that share a material are concatenated into one mesh, so the model costs one
+	// texture bind sequence and draw per material instead of per shape.
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
         std::cout << "Loading : " << fileName << std::endl;
+		auto loadStart = std::chrono::steady_clock::now();
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = gps::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -43,191 +390,638 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
-		// Loop over shapes
+		// everything tinyobj produced stays alive until the last shape is converted
+		size_t parsedBytes = (attrib.vertices.capacity() + attrib.normals.capacity() + attrib.texcoords.capacity()) * sizeof(float);
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			parsedBytes += shapes[s].mesh.indices.capacity() * sizeof(tinyobj::index_t)
+				+ shapes[s].mesh.num_face_vertices.capacity() + shapes[s].mesh.material_ids.capacity() * sizeof(int);
+		}
+		size_t meshBytes = 0;
 
-			// Loop over faces(polygon)
-			size_t index_offset = 0;
-			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-				int fv = shapes[s].mesh.num_face_vertices[f];
-
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
-
-				// Loop over vertices in the face.
-				for (size_t v = 0; v < fv; v++) {
-					// access to vertex
-					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-
-					float vx = attrib.vertices[3 * idx.vertex_index + 0];
-					float vy = attrib.vertices[3 * idx.vertex_index + 1];
-					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
-					float tx = 0.0f;
-					float ty = 0.0f;
-					if (idx.texcoord_index != -1) {
-						tx = attrib.texcoords[2 * idx.texcoord_index + 0];
-						ty = attrib.texcoords[2 * idx.texcoord_index + 1];
+		// shapes of each material in material order; -1 collects the shapes without one
+		std::map<int, std::vector<size_t>> materialShapes;
+		for (size_t s = 0; s < shapes.size(); s++) {
+			// Only try to read materials if the .mtl file is present
+			materialId = -1;
+			if (shapes[s].mesh.material_ids.size() > 0 && materials.size() > 0) {
+				materialId = shapes[s].mesh.material_ids[0];
+			}
+			materialShapes[materialId].push_back(s);
+		}
+
+		for (auto group = materialShapes.begin(); group != materialShapes.end(); ++group) {
+			const tinyobj::material_t* material = group->first >= 0 && group->first < (int)materials.size() ? &materials[group->first] : NULL;
+			std::vector<gps::Vertex> mergedVertices;
+			std::vector<GLuint> mergedIndices;
+			std::vector<gps::MeshShape> mergedShapes;
+
+			// Loop over the shapes of the material
+			for (size_t g = 0; g < group->second.size(); g++) {
+				size_t s = group->second[g];
+				std::vector<gps::Vertex> vertices;
+				std::vector<GLuint> indices;
+
+				// maps every distinct (position, normal, texcoord) tuple to its slot in `vertices`
+				VertexMap uniqueVertices;
+				uniqueVertices.reserve(shapes[s].mesh.indices.size());
+				indices.reserve(shapes[s].mesh.indices.size());
+
+				// Loop over faces(polygon)
+				size_t index_offset = 0;
+				for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
+					int fv = shapes[s].mesh.num_face_vertices[f];
+
+					// Loop over vertices in the face.
+					for (size_t v = 0; v < fv; v++) {
+						// access to vertex
+						tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+
+						gps::Vertex currentVertex = readVertex(attrib, idx);
+
+						// reuse the vertex if an identical one was already emitted for this shape
+						auto inserted = uniqueVertices.emplace(currentVertex, (GLuint)vertices.size());
+						if (inserted.second) {
+							vertices.push_back(currentVertex);
+						}
+
+						indices.push_back(inserted.first->second);
 					}
 
-					glm::vec3 vertexPosition(vx, vy, vz);
-					glm::vec3 vertexNormal(nx, ny, nz);
-					glm::vec2 vertexTexCoords(tx, ty);
+					index_offset += fv;
+				}
+
+				std::cout << "  shape " << s << " (" << shapes[s].name << ") : "
+					<< indices.size() << " corners -> " << vertices.size() << " unique vertices, dedup ratio "
+					<< (vertices.empty() ? 0.0 : (double)indices.size() / vertices.size()) << ":1" << std::endl;
 
-					gps::Vertex currentVertex;
-					currentVertex.Position = vertexPosition;
-					currentVertex.Normal = vertexNormal;
-					currentVertex.TexCoords = vertexTexCoords;
+				// done per shape so every shape stays one contiguous range of the merged mesh,
+				// and before the mesh cache is written so cached loads get the optimized order for free
+				OptimizeMesh(&vertices, &indices);
 
-					vertices.push_back(currentVertex);
+				size_t shapeBytes = vertices.capacity() * sizeof(gps::Vertex) + indices.capacity() * sizeof(GLuint);
+				size_t mergedBytes = mergedVertices.capacity() * sizeof(gps::Vertex) + mergedIndices.capacity() * sizeof(GLuint);
+				stats.peakLoadBytes = std::max(stats.peakLoadBytes, parsedBytes + meshBytes + mergedBytes + shapeBytes + vertexMapBytes(uniqueVertices));
 
-					indices.push_back(index_offset + v);
+				if (!mergedVertices.empty() && mergedVertices.size() + vertices.size() > MERGED_MESH_MAX_VERTICES) {
+					meshBytes += AddMergedMesh(&mergedVertices, &mergedIndices, &mergedShapes, material, basePath);
 				}
 
-				index_offset += fv;
+				gps::MeshShape shape = {shapes[s].name, (GLuint)mergedIndices.size(), (GLuint)indices.size(),
+										(GLuint)mergedVertices.size(), (GLuint)vertices.size()};
+				for (size_t i = 0; i < indices.size(); i++) {
+					mergedIndices.push_back(indices[i] + shape.firstVertex);
+				}
+				mergedVertices.insert(mergedVertices.end(), vertices.begin(), vertices.end());
+				mergedShapes.push_back(shape);
 			}
 
-			// get material id
-			// Only try to read materials if the .mtl file is present
-			int a = shapes[s].mesh.material_ids.size();
-			if (a > 0 && materials.size()>0) {
-				materialId = shapes[s].mesh.material_ids[0];
-				if (materialId != -1) {
-					gps::Material currentMaterial;
-					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
-					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
-					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
-
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
-					if (!ambientTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
-					}
+			meshBytes += AddMergedMesh(&mergedVertices, &mergedIndices, &mergedShapes, material, basePath);
+		}
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-					if (!diffuseTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
-					}
+		stats.loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+	}
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
-					if (!specularTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
-					}
-				}
+	// Meshes from this size on are split into clusters for culling
+	static const size_t CLUSTER_MIN_TRIANGLES = 4096;
+	static const size_t CLUSTER_MAX_VERTICES = 96;
+	static const size_t CLUSTER_MAX_TRIANGLES = 128;
+
+	// Turns the concatenated shapes of one material into a mesh and empties the arrays
+	size_t Model3D::AddMergedMesh(std::vector<gps::Vertex>* vertices, std::vector<GLuint>* indices, std::vector<gps::MeshShape>* shapes,
+								  const tinyobj::material_t* material, std::string basePath) {
+		if (indices->empty()) {
+			vertices->clear();
+			shapes->clear();
+			return 0;
+		}
+
+		std::cout << "  mesh " << meshes.size() << " (" << (material != NULL ? material->name : std::string("no material")) << ") : "
+			<< shapes->size() << " shapes, " << vertices->size() << " vertices, " << indices->size() / 3 << " triangles" << std::endl;
+
+		std::vector<gps::MeshLod> lods;
+		GenerateLods(*vertices, indices, &lods);
+		// clustered shape by shape so the shape ranges stay valid
+		std::vector<gps::MeshCluster> clusters;
+		if (lods[0].indexCount / 3 >= CLUSTER_MIN_TRIANGLES) {
+			for (size_t s = 0; s < shapes->size(); s++) {
+				gps::buildClusters(&clusters, indices->data(), (*shapes)[s].firstIndex, (*shapes)[s].indexCount,
+								   vertices->data(), vertices->size(), CLUSTER_MAX_VERTICES, CLUSTER_MAX_TRIANGLES);
 			}
+		}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+		std::vector<gps::Texture> textures;
+		gps::Material currentMaterial = {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)};
+		if (material != NULL) {
+			ReadMaterial(*material, basePath, &currentMaterial, &textures);
 		}
+
+		size_t vertexCount = vertices->size();
+		size_t indexCount = indices->size();
+		stats.vertexCount += vertexCount;
+		stats.indexCount += indexCount;
+
+		meshes.emplace_back(std::move(*vertices), std::move(*indices), std::move(textures), vertexFormat);
+		meshes.back().setLods(std::move(lods));
+		meshes.back().setClusters(std::move(clusters));
+		meshMaterials.push_back(currentMaterial);
+		meshShapes.push_back(std::move(*shapes));
+		stats.vertexBytes += vertexCount * meshes.back().getVertexStride();
+		stats.indexBytes += meshes.back().getIndexBytes();
+		stats.indexBytesSaved += indexCount * sizeof(GLuint) - meshes.back().getIndexBytes();
+
+		vertices->clear();
+		indices->clear();
+		shapes->clear();
+		return vertexCount * sizeof(gps::Vertex) + indexCount * sizeof(GLuint);
 	}
 
-	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	// Reorders the triangles for the post-transform cache and overdraw, then the vertices for fetch locality
+	void Model3D::OptimizeMesh(std::vector<gps::Vertex>* vertices, std::vector<GLuint>* indices) {
+		if (indices->empty()) {
+			return;
+		}
+		gps::VertexCacheStats before = gps::analyzeVertexCache(indices->data(), indices->size(), vertices->size());
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
+		std::vector<GLuint> cacheOrder(indices->size());
+		gps::optimizeVertexCache(cacheOrder.data(), indices->data(), indices->size(), vertices->size());
+		gps::optimizeOverdraw(indices->data(), cacheOrder.data(), indices->size(), vertices->data(), vertices->size());
+
+		std::vector<gps::Vertex> fetchOrder(vertices->size());
+		fetchOrder.resize(gps::optimizeVertexFetch(fetchOrder.data(), indices->data(), indices->size(), vertices->data(), vertices->size()));
+		vertices->swap(fetchOrder);
+
+		gps::VertexCacheStats after = gps::analyzeVertexCache(indices->data(), indices->size(), vertices->size());
+		std::cout << "    vertex cache : ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+	}
+
+	// Shapes below this size are drawn at full detail only
+	static const size_t LOD_MIN_TRIANGLES = 1024;
+	static const size_t LOD_MAX_LEVELS = 4;
+	// Simplification stops once a collapse would move the surface by more than this fraction of the shape size
+	static const float LOD_MAX_ERROR = 0.05f;
+
+	// Builds each level by halving the previous one; stops early when the simplifier cannot make
+	// a level at least a fifth smaller than the one before
+	void Model3D::GenerateLods(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>* indices, std::vector<gps::MeshLod>* lods) {
+		lods->assign(1, gps::MeshLod{0, (GLuint)indices->size(), (GLuint)vertices.size(), 0.0f});
+		if (indices->size() / 3 < LOD_MIN_TRIANGLES) {
+			return;
+		}
+
+		std::vector<GLuint> previous(*indices);
+		std::vector<GLuint> simplified(previous.size());
+		std::vector<unsigned char> used(vertices.size());
+		while (lods->size() < LOD_MAX_LEVELS) {
+			size_t target = previous.size() / 6 * 3;
+			float error = 0.0f;
+			size_t count = gps::simplifyMesh(simplified.data(), previous.data(), previous.size(), vertices.data(), vertices.size(),
+											 target, LOD_MAX_ERROR, &error);
+			if (count == 0 || count * 5 > previous.size() * 4) {
+				break;
+			}
+
+			previous.resize(count);
+			gps::optimizeVertexCache(previous.data(), simplified.data(), count, vertices.size());
+
+			std::fill(used.begin(), used.end(), 0);
+			GLuint vertexCount = 0;
+			for (size_t i = 0; i < count; i++) {
+				vertexCount += used[previous[i]] == 0;
+				used[previous[i]] = 1;
+			}
+
+			// every level is simplified from the last one, so their errors add up
+			gps::MeshLod lod = {(GLuint)indices->size(), (GLuint)count, vertexCount, lods->back().error + error};
+			indices->insert(indices->end(), previous.begin(), previous.end());
+			lods->push_back(lod);
+		}
+
+		for (size_t l = 1; l < lods->size(); l++) {
+			std::cout << "    LOD " << l << " : " << (*lods)[l].indexCount / 3 << " triangles, "
+				<< (*lods)[l].vertexCount << " vertices, error " << (*lods)[l].error << std::endl;
+		}
+	}
+
+	// Upper bound of the CPU staging arrays used while streaming an .obj file
+	static const size_t STREAM_STAGING_VERTICES = 64 * 1024;
+	static const size_t STREAM_STAGING_INDICES = 3 * STREAM_STAGING_VERTICES;
+
+	// GPU buffer that grows while staging chunks are appended to it
+	struct StreamBuffer {
+		GLuint id = 0;
+		size_t capacity = 0;
+		size_t size = 0;
+	};
+
+	// Appends data to a StreamBuffer, doubling it on the GPU when it runs out of room.
+	// Only the copy targets are used so the bound VAO never sees these buffers.
+	static void appendToBuffer(StreamBuffer* buffer, const void* data, size_t bytes) {
+		if (buffer->size + bytes > buffer->capacity) {
+			size_t capacity = std::max(buffer->size + bytes, std::max(buffer->capacity * 2, (size_t)64 * 1024));
+
+			GLuint grown;
+			glGenBuffers(1, &grown);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+			glBufferData(GL_COPY_WRITE_BUFFER, capacity, NULL, GL_STATIC_DRAW);
+			if (buffer->id) {
+				glBindBuffer(GL_COPY_READ_BUFFER, buffer->id);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, buffer->size);
+				glDeleteBuffers(1, &buffer->id);
+			}
+			buffer->id = grown;
+			buffer->capacity = capacity;
+		}
+
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer->id);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, buffer->size, bytes, data);
+		buffer->size += bytes;
+	}
+
+	// One shape being streamed to the GPU
+	struct StreamedShape {
+		std::string name;
+		int materialId = -1;
+		StreamBuffer vertexBuffer;
+		StreamBuffer indexBuffer;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		size_t cornerCount = 0;
+		gps::Bounds bounds;
+	};
+
+	// State shared by the tinyobj callbacks while streaming
+	struct ObjStreamState {
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::material_t> materials;
+		int materialId = -1;
+		std::string name;
+
+		std::vector<StreamedShape> shapes;
+		bool shapeOpen = false;
+
+		// bounded staging chunk; indices are already relative to the whole shape
+		std::vector<gps::Vertex> stagingVertices;
+		std::vector<GLuint> stagingIndices;
+		VertexMap stagingMap;
+
+		size_t peakBytes = 0;
+	};
+
+	static void trackStreamMemory(ObjStreamState* state) {
+		size_t bytes = (state->attrib.vertices.capacity() + state->attrib.normals.capacity() + state->attrib.texcoords.capacity()) * sizeof(float)
+			+ state->stagingVertices.capacity() * sizeof(gps::Vertex)
+			+ state->stagingIndices.capacity() * sizeof(GLuint)
+			+ vertexMapBytes(state->stagingMap);
+		state->peakBytes = std::max(state->peakBytes, bytes);
+	}
+
+	// Uploads the staging chunk into the current shape's buffers and empties it
+	static void flushStaging(ObjStreamState* state) {
+		if (state->shapes.empty() || state->stagingIndices.empty()) {
+			return;
+		}
+		trackStreamMemory(state);
+
+		StreamedShape& shape = state->shapes.back();
+		appendToBuffer(&shape.vertexBuffer, state->stagingVertices.data(), state->stagingVertices.size() * sizeof(gps::Vertex));
+		appendToBuffer(&shape.indexBuffer, state->stagingIndices.data(), state->stagingIndices.size() * sizeof(GLuint));
+		shape.vertexCount += state->stagingVertices.size();
+		shape.indexCount += state->stagingIndices.size();
+		shape.bounds = gps::mergeBounds(shape.bounds, gps::computeBounds(&state->stagingVertices.data()->Position.x,
+																		  state->stagingVertices.size(), sizeof(gps::Vertex)));
+
+		state->stagingVertices.clear();
+		state->stagingIndices.clear();
+		state->stagingMap.clear();
+	}
+
+	// Called on g/o; the next face starts a new shape like tinyobj::LoadObj does
+	static void closeShape(ObjStreamState* state) {
+		flushStaging(state);
+		state->shapeOpen = false;
+	}
+
+	static void streamVertex(void* userData, float x, float y, float z, float) {
+		tinyobj::attrib_t& attrib = ((ObjStreamState*)userData)->attrib;
+		attrib.vertices.push_back(x);
+		attrib.vertices.push_back(y);
+		attrib.vertices.push_back(z);
+	}
+
+	static void streamNormal(void* userData, float x, float y, float z) {
+		tinyobj::attrib_t& attrib = ((ObjStreamState*)userData)->attrib;
+		attrib.normals.push_back(x);
+		attrib.normals.push_back(y);
+		attrib.normals.push_back(z);
+	}
+
+	static void streamTexcoord(void* userData, float x, float y, float) {
+		tinyobj::attrib_t& attrib = ((ObjStreamState*)userData)->attrib;
+		attrib.texcoords.push_back(x);
+		attrib.texcoords.push_back(y);
+	}
+
+	// Raw callback indices are 1-based, negative for relative and 0 when missing
+	static int resolveStreamIndex(int idx, size_t count) {
+		if (idx > 0) return idx - 1;
+		if (idx < 0) return (int)count + idx;
+		return -1;
+	}
+
+	static void streamFace(void* userData, tinyobj::index_t* indices, int numIndices) {
+		ObjStreamState* state = (ObjStreamState*)userData;
+		if (numIndices < 3) {
+			return;
+		}
+
+		if (!state->shapeOpen) {
+			StreamedShape shape;
+			shape.name = state->name;
+			// like ReadOBJ, the shape takes the material of its first face
+			shape.materialId = state->materialId;
+			state->shapes.push_back(shape);
+			state->shapeOpen = true;
+		}
+		StreamedShape& shape = state->shapes.back();
+
+		tinyobj::index_t corners[3];
+		for (int k = 2; k < numIndices; k++) {
+			// Polygon -> triangle fan conversion
+			corners[0] = indices[0];
+			corners[1] = indices[k - 1];
+			corners[2] = indices[k];
+
+			for (int c = 0; c < 3; c++) {
+				tinyobj::index_t idx;
+				idx.vertex_index = resolveStreamIndex(corners[c].vertex_index, state->attrib.vertices.size() / 3);
+				idx.normal_index = resolveStreamIndex(corners[c].normal_index, state->attrib.normals.size() / 3);
+				idx.texcoord_index = resolveStreamIndex(corners[c].texcoord_index, state->attrib.texcoords.size() / 2);
+
+				gps::Vertex vertex = readVertex(state->attrib, idx);
+				auto inserted = state->stagingMap.emplace(vertex, (GLuint)(shape.vertexCount + state->stagingVertices.size()));
+				if (inserted.second) {
+					state->stagingVertices.push_back(vertex);
 				}
+				state->stagingIndices.push_back(inserted.first->second);
+			}
+			shape.cornerCount += 3;
+		}
+
+		if (state->stagingVertices.size() >= STREAM_STAGING_VERTICES || state->stagingIndices.size() >= STREAM_STAGING_INDICES) {
+			flushStaging(state);
+		}
+	}
+
+	static void streamUseMaterial(void* userData, const char*, int materialId) {
+		((ObjStreamState*)userData)->materialId = materialId;
+	}
+
+	static void streamMaterialLibrary(void* userData, const tinyobj::material_t* materials, int numMaterials) {
+		ObjStreamState* state = (ObjStreamState*)userData;
+		state->materials.assign(materials, materials + numMaterials);
+	}
+
+	static void streamGroup(void* userData, const char** names, int numNames) {
+		ObjStreamState* state = (ObjStreamState*)userData;
+		closeShape(state);
+		state->name = numNames > 0 ? names[0] : "";
+	}
+
+	static void streamObject(void* userData, const char* name) {
+		ObjStreamState* state = (ObjStreamState*)userData;
+		closeShape(state);
+		state->name = name;
+	}
+
+	// Parses the .obj file through tinyobj's callback API and uploads the geometry in bounded chunks,
+	// so the full vertex/index arrays of a shape never exist on the CPU side
+	void Model3D::ReadOBJStreaming(std::string fileName, std::string basePath) {
+
+		std::cout << "Loading : " << fileName << " (streaming)" << std::endl;
+		auto loadStart = std::chrono::steady_clock::now();
+
+		std::ifstream file(fileName.c_str());
+		if (!file) {
+			std::cerr << "Cannot open file [" << fileName << "]" << std::endl;
+			exit(1);
+		}
+
+		ObjStreamState state;
+		state.stagingVertices.reserve(STREAM_STAGING_VERTICES);
+		state.stagingIndices.reserve(STREAM_STAGING_INDICES + 3);
+		state.stagingMap.reserve(STREAM_STAGING_VERTICES);
+
+		tinyobj::callback_t callback;
+		callback.vertex_cb = streamVertex;
+		callback.normal_cb = streamNormal;
+		callback.texcoord_cb = streamTexcoord;
+		callback.index_cb = streamFace;
+		callback.usemtl_cb = streamUseMaterial;
+		callback.mtllib_cb = streamMaterialLibrary;
+		callback.group_cb = streamGroup;
+		callback.object_cb = streamObject;
+
+		std::string err;
+		tinyobj::MaterialFileReader materialReader(basePath);
+		bool ret = tinyobj::LoadObjWithCallback(file, callback, &state, &materialReader, &err);
+		flushStaging(&state);
+
+		if (!err.empty()) { // `err` may contain warning message.
+			std::cerr << err << std::endl;
+		}
+
+		if (!ret) {
+			exit(1);
+		}
+
+		std::cout << "# of shapes    : " << state.shapes.size() << std::endl;
+		std::cout << "# of materials : " << state.materials.size() << std::endl;
+
+		for (size_t s = 0; s < state.shapes.size(); s++) {
+			StreamedShape& shape = state.shapes[s];
+
+			std::cout << "  shape " << s << " (" << shape.name << ") : "
+				<< shape.cornerCount << " corners -> " << shape.vertexCount << " unique vertices, dedup ratio "
+				<< (shape.vertexCount == 0 ? 0.0 : (double)shape.cornerCount / shape.vertexCount) << ":1" << std::endl;
+
+			stats.vertexCount += shape.vertexCount;
+			stats.indexCount += shape.indexCount;
+			stats.vertexBytes += shape.vertexCount * sizeof(gps::Vertex);
+			stats.indexBytes += shape.indexCount * sizeof(GLuint);
+
+			gps::Material currentMaterial = {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f)};
+			std::vector<gps::Texture> textures;
+			if (shape.materialId >= 0 && shape.materialId < (int)state.materials.size()) {
+				ReadMaterial(state.materials[shape.materialId], basePath, &currentMaterial, &textures);
 			}
 
+			meshes.emplace_back(gps::BufferHandle(shape.vertexBuffer.id), gps::BufferHandle(shape.indexBuffer.id),
+								shape.vertexCount, shape.indexCount, std::move(textures), shape.bounds);
+			meshMaterials.push_back(currentMaterial);
+			meshShapes.push_back(std::vector<gps::MeshShape>(1, gps::MeshShape{shape.name, 0, (GLuint)shape.indexCount, 0, (GLuint)shape.vertexCount}));
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		stats.peakLoadBytes = state.peakBytes;
+		stats.loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+	}
+
+	// Fills in the material colors and loads the textures it references
+	void Model3D::ReadMaterial(const tinyobj::material_t& material, std::string basePath, gps::Material* currentMaterial, std::vector<gps::Texture>* textures) {
+		currentMaterial->ambient = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
+		currentMaterial->diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+		currentMaterial->specular = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+
+		//ambient texture
+		std::string ambientTexturePath = material.ambient_texname;
+		if (!ambientTexturePath.empty())
+		{
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+			currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
+			textures->push_back(currentTexture);
+		}
 
-			loadedTextures.push_back(currentTexture);
+		//diffuse texture
+		std::string diffuseTexturePath = material.diffuse_texname;
+		if (!diffuseTexturePath.empty())
+		{
+			gps::Texture currentTexture;
+			currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
+			textures->push_back(currentTexture);
+		}
 
-			return currentTexture;
+		//specular texture
+		std::string specularTexturePath = material.specular_texname;
+		if (!specularTexturePath.empty())
+		{
+			gps::Texture currentTexture;
+			currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
+			textures->push_back(currentTexture);
 		}
+	}
+
+	void Model3D::PrintStats() {
+		size_t shapeCount = 0;
+		for (size_t i = 0; i < meshShapes.size(); i++) {
+			shapeCount += meshShapes[i].size();
+		}
+		std::cout << "# of meshes    : " << meshes.size() << " (from " << shapeCount << " shapes)" << std::endl;
+		std::cout << "# of vertices  : " << stats.vertexCount << " (" << stats.vertexBytes << " VBO bytes)" << std::endl;
+		std::cout << "# of indices   : " << stats.indexCount << " (" << stats.indexBytes << " EBO bytes, "
+			<< stats.indexBytesSaved << " saved by 16 bit indices)" << std::endl;
+		std::cout << "Peak load mem  : " << stats.peakLoadBytes << " bytes" << std::endl;
+		std::cout << "Load time      : " << stats.loadTimeMs << " ms" << std::endl;
+		std::cout << "Clusters       : " << stats.clusterCount << std::endl;
+		for (size_t l = 0; l < stats.lodTriangleCounts.size(); l++) {
+			std::cout << "LOD " << l << "          : " << stats.lodTriangleCounts[l] << " triangles, "
+				<< stats.lodVertexCounts[l] << " vertices" << std::endl;
+		}
+		std::cout << "Bounds         : (" << bounds.min.x << ", " << bounds.min.y << ", " << bounds.min.z << ") - ("
+			<< bounds.max.x << ", " << bounds.max.y << ", " << bounds.max.z << "), radius " << bounds.radius << std::endl;
+		std::cout << "CPU geometry   : " << stats.releasedBytes << " bytes released, RSS " << stats.residentBytesBeforeRelease
+			<< " -> " << stats.residentBytesAfterRelease << " bytes" << std::endl;
+
+		// the arena of the format the meshes were actually created with
+		gps::GeometryArenaStats arenaStats = gps::Mesh::arenaFor(vertexFormat).getStats();
+		std::cout << "Geometry arena : " << arenaStats.allocationCount << " meshes in " << arenaStats.pageCount << " pages, "
+			<< arenaStats.usedBytes << " of " << arenaStats.capacityBytes << " bytes used" << std::endl;
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
+		gps::TextureCacheStats textureStats = gps::TextureCache::instance().getStats();
+		std::cout << "Texture cache  : " << textureStats.textureCount << " textures, " << textureStats.referenceCount << " references, "
+			<< textureStats.gpuBytes << " bytes (" << textureStats.savedBytes << " bytes saved by sharing)" << std::endl;
+	}
+
+	// Loads the meshes from the binary cache next to the .obj file, if it is still valid
+	bool Model3D::ReadCache(std::string fileName) {
+		auto loadStart = std::chrono::steady_clock::now();
+
+		gps::MeshCache cache;
+		if (!cache.open(fileName)) {
 			return false;
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
-
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+
+		std::cout << "Loading : " << fileName << " (cached)" << std::endl;
+		const std::vector<gps::CachedMesh>& cachedMeshes = cache.getMeshes();
+		for (size_t i = 0; i < cachedMeshes.size(); i++) {
+			const gps::CachedMesh& cachedMesh = cachedMeshes[i];
+
+			std::vector<gps::Texture> textures;
+			for (size_t t = 0; t < cachedMesh.textures.size(); t++) {
+				textures.push_back(LoadTexture(cachedMesh.textures[t].path, cachedMesh.textures[t].type));
+			}
+
+			meshes.emplace_back(cachedMesh.vertices, cachedMesh.vertexCount, cachedMesh.indices, cachedMesh.indexType,
+								cachedMesh.indexCount, std::move(textures), vertexFormat);
+			meshes.back().setLods(cachedMesh.lods);
+			meshes.back().setClusters(cachedMesh.clusters);
+			// only the copies the retention policy keeps are made, while the file is still mapped
+			size_t keptBytes = meshes.back().keepCpuData(cachedMesh.vertices, cachedMesh.vertexCount, cachedMesh.indices,
+														 cachedMesh.indexType, cachedMesh.indexCount, retention);
+			meshMaterials.push_back(cachedMesh.material);
+			meshShapes.push_back(cachedMesh.shapes);
+
+			stats.vertexCount += cachedMesh.vertexCount;
+			stats.indexCount += cachedMesh.indexCount;
+			stats.vertexBytes += cachedMesh.vertexCount * meshes.back().getVertexStride();
+			stats.indexBytes += meshes.back().getIndexBytes();
+			stats.indexBytesSaved += cachedMesh.indexCount * sizeof(GLuint) - meshes.back().getIndexBytes();
+			// the arrays themselves stay in the page cache, only the retained copies are heap memory
+			stats.peakLoadBytes += keptBytes;
+		}
+
+		stats.loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+
+		return true;
+	}
+
+	// Stores the final meshes in a binary cache so the next run can skip the .obj parsing
+	void Model3D::WriteCache(std::string fileName) {
+		std::vector<gps::CachedMesh> cachedMeshes;
+		// the cache stores indices in the same width as the EBO, so cached loads upload them as they are
+		std::vector<std::vector<GLushort>> shortIndices(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			gps::CachedMesh cachedMesh;
+			cachedMesh.vertices = meshes[i].vertices.data();
+			cachedMesh.vertexCount = (uint32_t)meshes[i].vertices.size();
+			cachedMesh.indices = meshes[i].indices.data();
+			cachedMesh.indexCount = (uint32_t)meshes[i].indices.size();
+			cachedMesh.indexType = meshes[i].getBuffers().indexType;
+			if (cachedMesh.indexType == GL_UNSIGNED_SHORT) {
+				shortIndices[i].assign(meshes[i].indices.begin(), meshes[i].indices.end());
+				cachedMesh.indices = shortIndices[i].data();
+			}
+			cachedMesh.material = meshMaterials[i];
+			cachedMesh.textures = meshes[i].textures;
+			cachedMesh.lods = meshes[i].getLods();
+			cachedMesh.clusters = meshes[i].getClusters();
+			cachedMesh.shapes = meshShapes[i];
+			cachedMeshes.push_back(cachedMesh);
+		}
+
+		gps::MeshCache::write(fileName, cachedMeshes);
 	}
 
+	// Retrieves a texture associated with the object - by its name and type.
+	// The GL texture comes from the shared cache; the model keeps one reference per use.
+	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+
+			gps::Texture currentTexture;
+			currentTexture.id = gps::TextureCache::instance().acquire(path, type);
+			currentTexture.type = std::string(type);
+			currentTexture.path = path;
+
+			loadedTextures.push_back(currentTexture);
+
+			return currentTexture;
+		}
+
 	Model3D::~Model3D() {
         for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            gps::TextureCache::instance().release(loadedTextures.at(i).path, loadedTextures.at(i).type);
         }
 
-        for (size_t i = 0; i < meshes.size(); i++) {
-            GLuint VBO = meshes.at(i).getBuffers().VBO;
-            GLuint EBO = meshes.at(i).getBuffers().EBO;
-            GLuint VAO = meshes.at(i).getBuffers().VAO;
-            glDeleteBuffers(1, &VBO);
-            glDeleteBuffers(1, &EBO);
-            glDeleteVertexArrays(1, &VAO);
-        }
+        // the meshes give their geometry ranges back to the arena themselves
 	}
 }
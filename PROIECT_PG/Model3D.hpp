@@ -12,6 +12,53 @@
 
 namespace gps {
 
+    // How LoadModel turns an .obj file into meshes when there is no valid mesh cache
+    enum ModelLoadMode {
+        // parse the whole file, build each shape in memory and write the mesh cache
+        MODEL_LOAD_FULL,
+        // build shapes in bounded staging chunks and upload them as they fill; no mesh cache is written
+        MODEL_LOAD_STREAMING
+    };
+
+    // Geometry totals gathered while loading a model
+    struct ModelStats {
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        size_t vertexBytes = 0;
+        size_t indexBytes = 0;
+        // EBO bytes saved by storing small meshes with 16 bit indices
+        size_t indexBytesSaved = 0;
+        // high-water mark of the CPU memory owned by the loader
+        size_t peakLoadBytes = 0;
+        double loadTimeMs = 0.0;
+        // CPU geometry freed by the retention policy, and the process RSS around that release
+        size_t releasedBytes = 0;
+        size_t residentBytesBeforeRelease = 0;
+        size_t residentBytesAfterRelease = 0;
+        // triangles and referenced vertices of each level of detail, summed over the meshes
+        std::vector<size_t> lodTriangleCounts;
+        std::vector<size_t> lodVertexCounts;
+        // culling clusters of the full detail levels
+        size_t clusterCount = 0;
+    };
+
+    // View inputs of the level of detail selection
+    struct LodSelection {
+        glm::vec3 cameraPosition;
+        // viewport height / (2 tan(fovY / 2)): pixels covered by one unit at distance one
+        float projectionScale;
+        // largest simplification error allowed on screen, in pixels
+        float pixelError = 1.0f;
+    };
+
+    // View the meshes and their clusters are culled against
+    struct CullView {
+        // projection * view
+        glm::mat4 viewProjection;
+        // camera position (w = 1), or the view direction of an orthographic projection (w = 0)
+        glm::vec4 eye;
+    };
+
     class Model3D
     {
 
@@ -22,22 +69,106 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		void Draw(gps::Shader& shaderProgram);
+
+		// Draws with the given model matrix; sets the "model" uniform per mesh so packed meshes get dequantized.
+		// Programs with the DrawUniforms block get a view space normal matrix built with view.
+		void Draw(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view);
+
+		// Same as above, but each mesh uses the coarsest level whose error projects to at most
+		// selection.pixelError pixels. A level is kept until it is clearly too coarse or clearly
+		// finer than needed, so meshes near a threshold do not switch every frame.
+		// With a cullView, meshes outside its frustum are skipped and full detail meshes only draw
+		// the clusters that are in the frustum and not facing away; cullStats adds up the triangles.
+		void Draw(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view, const LodSelection& selection,
+				  const CullView* cullView = NULL, gps::CullStats* cullStats = NULL);
+
+		size_t getMeshCount();
+
+		// Source shapes (OBJ o/g) a mesh was merged from; the ranges refer to its full detail level
+		const std::vector<gps::MeshShape>& getMeshShapes(size_t mesh);
+
+		// Finds the mesh and range a source shape ended up in; returns false if there is no such shape
+		bool findShape(std::string name, size_t* mesh, gps::MeshShape* shape);
+
+		// Draws every mesh at the given level (clamped to the levels it has); -1 selects automatically
+		void setForcedLod(int lod);
+
+		// Selects how the next LoadModel call reads the .obj file
+		void setLoadMode(ModelLoadMode mode);
+
+		// Selects the GPU vertex layout of the next LoadModel call; streamed models always use floats
+		void setVertexFormat(VertexFormat format);
+
+		// Selects which CPU copies of the geometry the meshes keep after LoadModel uploads them
+		void setRetention(MeshRetention retention);
+
+		// Returns the vertex/index totals and load time of the loaded model
+		ModelStats getStats();
+
+		// Box and sphere around all meshes, in model space or transformed by a model matrix
+		gps::Bounds getBounds();
+		gps::Bounds getBounds(glm::mat4 modelMatrix);
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
+		// Associated textures; each entry holds one reference in the shared TextureCache
         std::vector<gps::Texture> loadedTextures;
+		// Material of each mesh, kept so it can be written to the mesh cache
+		std::vector<gps::Material> meshMaterials;
+		// Source shapes of each mesh
+		std::vector<std::vector<gps::MeshShape>> meshShapes;
+		// Geometry totals of the loaded meshes
+		ModelStats stats;
+		// Union of the mesh bounds
+		gps::Bounds bounds;
+		ModelLoadMode loadMode = MODEL_LOAD_FULL;
+		VertexFormat vertexFormat = VERTEX_FORMAT_FLOAT;
+		MeshRetention retention = MESH_RETAIN_NONE;
+		// level each mesh was last drawn with by the selecting Draw
+		std::vector<size_t> meshLods;
+		int forcedLod = -1;
+		// ring offset of each mesh's DrawUniforms record in the current draw
+		std::vector<GLintptr> drawOffsets;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Reorders a shape for the post-transform cache, overdraw and vertex fetch; prints ACMR/ATVR before and after
+		void OptimizeMesh(std::vector<gps::Vertex>* vertices, std::vector<GLuint>* indices);
+
+		// Turns the concatenated shapes of one material into a mesh; returns the CPU bytes the mesh keeps
+		size_t AddMergedMesh(std::vector<gps::Vertex>* vertices, std::vector<GLuint>* indices, std::vector<gps::MeshShape>* shapes,
+							 const tinyobj::material_t* material, std::string basePath);
+
+		// Appends coarser versions of a shape to its index array; lods receives the range of every level
+		void GenerateLods(const std::vector<gps::Vertex>& vertices, std::vector<GLuint>* indices, std::vector<gps::MeshLod>* lods);
+
+		// Draws the meshes with the given level per mesh, culled against cullView if there is one
+		void DrawMeshes(gps::Shader& shaderProgram, glm::mat4 modelMatrix, glm::mat4 view, const std::vector<size_t>& levels,
+						const CullView* cullView, gps::CullStats* cullStats);
+
+		// Streams the .obj file through bounded staging chunks straight into GPU buffers
+		void ReadOBJStreaming(std::string fileName, std::string basePath);
+
+		// Fills in the material colors and loads the textures it references
+		void ReadMaterial(const tinyobj::material_t& material, std::string basePath, gps::Material* currentMaterial, std::vector<gps::Texture>* textures);
+
+		// Applies the retention policy to every mesh once the load is complete
+		void ReleaseCpuData();
+
+		// Prints the geometry totals after a load
+		void PrintStats();
+
+		// Loads the meshes from the binary cache of the .obj file; returns false if there is no valid cache
+		bool ReadCache(std::string fileName);
+
+		// Writes the loaded meshes to the binary cache of the .obj file
+		void WriteCache(std::string fileName);
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
-
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
     };
 }
 
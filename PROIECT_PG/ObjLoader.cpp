@@ -0,0 +1,502 @@
+#include "ObjLoader.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <thread>
+
+namespace gps {
+
+    // Chunks smaller than this are not worth a thread of their own
+    static const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+
+    // Per-face material slot meaning "whatever usemtl was active when the chunk started"
+    static const int OBJ_MATERIAL_INHERITED = -2;
+
+    // Faces of one chunk up to the next 'g'/'o' statement
+    struct ObjShapeSegment {
+        bool startsShape;
+        std::string name;
+        // material_ids hold slots into ObjChunk::materialNames until the merge resolves them
+        tinyobj::mesh_t mesh;
+    };
+
+    struct ObjChunk {
+        const char* begin;
+        const char* end;
+
+        size_t vertexCount;
+        size_t normalCount;
+        size_t texcoordCount;
+        size_t vertexBase;
+        size_t normalBase;
+        size_t texcoordBase;
+
+        std::vector<ObjShapeSegment> segments;
+        std::vector<std::string> materialNames;
+        std::vector<std::string> materialLibraries;
+        // slot of the last usemtl in the chunk, carried into the next chunk
+        int lastMaterial;
+    };
+
+    static inline bool isSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool isDigit(char c) {
+        return (unsigned)(c - '0') < 10u;
+    }
+
+    static inline const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+    // Returns the end of the line starting at p, without the trailing '\r'
+    static inline const char* lineEnd(const char* p, const char* end, const char** next) {
+        const char* newline = (const char*)memchr(p, '\n', end - p);
+        const char* stop = newline ? newline : end;
+        *next = newline ? newline + 1 : end;
+        if (stop > p && stop[-1] == '\r') {
+            stop--;
+        }
+        return stop;
+    }
+
+    static inline std::string parseWord(const char* p, const char* end) {
+        p = skipSpaces(p, end);
+        const char* start = p;
+        while (p < end && !isSpace(*p)) {
+            p++;
+        }
+        return std::string(start, p);
+    }
+
+    // Locale independent float parser; stops at the first character that is not part of the number
+    static inline float parseFloat(const char** token, const char* end) {
+        static const double powersOf10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const char* p = skipSpaces(*token, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        int digits = 0;
+        while (p < end && isDigit(*p)) {
+            // digits past the 19th do not fit in the mantissa, only their magnitude matters
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+            } else {
+                exponent++;
+            }
+            digits++;
+            p++;
+        }
+        if (p < end && *p == '.') {
+            p++;
+            while (p < end && isDigit(*p)) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+                digits++;
+                p++;
+            }
+        }
+        if (digits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+            const char* e = p + 1;
+            bool negativeExponent = false;
+            if (e < end && (*e == '-' || *e == '+')) {
+                negativeExponent = *e == '-';
+                e++;
+            }
+            if (e < end && isDigit(*e)) {
+                int value = 0;
+                while (e < end && isDigit(*e)) {
+                    if (value < 10000) {
+                        value = value * 10 + (*e - '0');
+                    }
+                    e++;
+                }
+                exponent += negativeExponent ? -value : value;
+                p = e;
+            }
+        }
+
+        *token = p;
+        if (digits == 0) {
+            return 0.0f;
+        }
+
+        double result = (double)mantissa;
+        if (exponent < 0) {
+            result = exponent >= -22 ? result / powersOf10[-exponent] : result * std::pow(10.0, exponent);
+        } else if (exponent > 0) {
+            result = exponent <= 22 ? result * powersOf10[exponent] : result * std::pow(10.0, exponent);
+        }
+        return (float)(negative ? -result : result);
+    }
+
+    static inline int parseInt(const char** token, const char* end) {
+        const char* p = *token;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        int value = 0;
+        while (p < end && isDigit(*p)) {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        *token = p;
+        return negative ? -value : value;
+    }
+
+    // Same convention as tinyobj: zero-based, negative values are relative to the current count
+    static inline int fixIndex(int idx, size_t count) {
+        if (idx > 0) return idx - 1;
+        if (idx == 0) return 0;
+        return (int)count + idx;
+    }
+
+    enum ObjRecord {
+        OBJ_RECORD_OTHER,
+        OBJ_RECORD_VERTEX,
+        OBJ_RECORD_NORMAL,
+        OBJ_RECORD_TEXCOORD
+    };
+
+    // Attribute record a line starts with; token and end delimit the line without its spaces
+    // and line break. Both passes classify with this so their counts always agree.
+    static inline ObjRecord classifyRecord(const char* token, const char* end) {
+        size_t length = end - token;
+        if (length > 1 && token[0] == 'v' && isSpace(token[1])) {
+            return OBJ_RECORD_VERTEX;
+        }
+        if (length > 2 && token[0] == 'v' && token[1] == 'n' && isSpace(token[2])) {
+            return OBJ_RECORD_NORMAL;
+        }
+        if (length > 2 && token[0] == 'v' && token[1] == 't' && isSpace(token[2])) {
+            return OBJ_RECORD_TEXCOORD;
+        }
+        return OBJ_RECORD_OTHER;
+    }
+
+    // First pass: count the attribute records so every chunk knows where its data goes
+    static void countChunk(ObjChunk* chunk) {
+        chunk->vertexCount = 0;
+        chunk->normalCount = 0;
+        chunk->texcoordCount = 0;
+
+        const char* next = chunk->begin;
+        while (next < chunk->end) {
+            const char* token = skipSpaces(next, chunk->end);
+            const char* end = lineEnd(token, chunk->end, &next);
+            switch (classifyRecord(token, end)) {
+                case OBJ_RECORD_VERTEX:
+                    chunk->vertexCount++;
+                    break;
+                case OBJ_RECORD_NORMAL:
+                    chunk->normalCount++;
+                    break;
+                case OBJ_RECORD_TEXCOORD:
+                    chunk->texcoordCount++;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    static ObjShapeSegment& currentSegment(ObjChunk* chunk) {
+        if (chunk->segments.empty()) {
+            ObjShapeSegment segment;
+            segment.startsShape = false;
+            chunk->segments.push_back(segment);
+        }
+        return chunk->segments.back();
+    }
+
+    // Second pass: parse the chunk, writing attributes in place and collecting faces
+    static void parseChunk(ObjChunk* chunk, tinyobj::attrib_t* attrib, bool triangulate) {
+        size_t vertexCount = chunk->vertexBase;
+        size_t normalCount = chunk->normalBase;
+        size_t texcoordCount = chunk->texcoordBase;
+        // the slots the first pass reserved for this chunk; nothing is written past them
+        size_t vertexLimit = chunk->vertexBase + chunk->vertexCount;
+        size_t normalLimit = chunk->normalBase + chunk->normalCount;
+        size_t texcoordLimit = chunk->texcoordBase + chunk->texcoordCount;
+        float* vertices = attrib->vertices.data();
+        float* normals = attrib->normals.data();
+        float* texcoords = attrib->texcoords.data();
+
+        int material = OBJ_MATERIAL_INHERITED;
+        std::vector<tinyobj::index_t> face;
+
+        const char* next = chunk->begin;
+        while (next < chunk->end) {
+            const char* token = skipSpaces(next, chunk->end);
+            const char* end = lineEnd(token, chunk->end, &next);
+            if (token == end || token[0] == '#') {
+                continue;
+            }
+            size_t length = end - token;
+            ObjRecord record = classifyRecord(token, end);
+
+            // vertex
+            if (record == OBJ_RECORD_VERTEX) {
+                if (vertexCount >= vertexLimit) {
+                    continue;
+                }
+                token += 2;
+                float* v = vertices + 3 * vertexCount++;
+                v[0] = parseFloat(&token, end);
+                v[1] = parseFloat(&token, end);
+                v[2] = parseFloat(&token, end);
+                continue;
+            }
+
+            // normal
+            if (record == OBJ_RECORD_NORMAL) {
+                if (normalCount >= normalLimit) {
+                    continue;
+                }
+                token += 3;
+                float* vn = normals + 3 * normalCount++;
+                vn[0] = parseFloat(&token, end);
+                vn[1] = parseFloat(&token, end);
+                vn[2] = parseFloat(&token, end);
+                continue;
+            }
+
+            // texcoord
+            if (record == OBJ_RECORD_TEXCOORD) {
+                if (texcoordCount >= texcoordLimit) {
+                    continue;
+                }
+                token += 3;
+                float* vt = texcoords + 2 * texcoordCount++;
+                vt[0] = parseFloat(&token, end);
+                vt[1] = parseFloat(&token, end);
+                continue;
+            }
+
+            // face
+            if (length > 1 && token[0] == 'f' && isSpace(token[1])) {
+                token = skipSpaces(token + 2, end);
+
+                face.clear();
+                while (token < end) {
+                    tinyobj::index_t idx;
+                    idx.vertex_index = fixIndex(parseInt(&token, end), vertexCount);
+                    idx.texcoord_index = -1;
+                    idx.normal_index = -1;
+                    if (token < end && *token == '/') {
+                        token++;
+                        if (token < end && *token == '/') {
+                            // i//k
+                            token++;
+                            idx.normal_index = fixIndex(parseInt(&token, end), normalCount);
+                        } else {
+                            // i/j or i/j/k
+                            idx.texcoord_index = fixIndex(parseInt(&token, end), texcoordCount);
+                            if (token < end && *token == '/') {
+                                token++;
+                                idx.normal_index = fixIndex(parseInt(&token, end), normalCount);
+                            }
+                        }
+                    }
+                    face.push_back(idx);
+
+                    // skip anything left of this corner, then the separator
+                    while (token < end && !isSpace(*token)) {
+                        token++;
+                    }
+                    token = skipSpaces(token, end);
+                }
+
+                if (face.size() < 2) {
+                    continue;
+                }
+
+                tinyobj::mesh_t& mesh = currentSegment(chunk).mesh;
+                if (triangulate) {
+                    // Polygon -> triangle fan conversion
+                    for (size_t k = 2; k < face.size(); k++) {
+                        mesh.indices.push_back(face[0]);
+                        mesh.indices.push_back(face[k - 1]);
+                        mesh.indices.push_back(face[k]);
+                        mesh.num_face_vertices.push_back(3);
+                        mesh.material_ids.push_back(material);
+                    }
+                } else {
+                    mesh.indices.insert(mesh.indices.end(), face.begin(), face.end());
+                    mesh.num_face_vertices.push_back((unsigned char)face.size());
+                    mesh.material_ids.push_back(material);
+                }
+                continue;
+            }
+
+            // use mtl
+            if (length > 6 && strncmp(token, "usemtl", 6) == 0 && isSpace(token[6])) {
+                material = (int)chunk->materialNames.size();
+                chunk->materialNames.push_back(parseWord(token + 7, end));
+                chunk->lastMaterial = material;
+                continue;
+            }
+
+            // load mtl
+            if (length > 6 && strncmp(token, "mtllib", 6) == 0 && isSpace(token[6])) {
+                chunk->materialLibraries.push_back(parseWord(token + 7, end));
+                continue;
+            }
+
+            // group or object name; both start a new shape
+            if (length > 1 && (token[0] == 'g' || token[0] == 'o') && isSpace(token[1])) {
+                ObjShapeSegment segment;
+                segment.startsShape = true;
+                segment.name = parseWord(token + 2, end);
+                chunk->segments.push_back(segment);
+                continue;
+            }
+
+            // Ignore unknown command.
+        }
+    }
+
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const char* filename, const char* mtl_basepath, bool triangulate) {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file;
+        if (!file.open(filename)) {
+            if (err) {
+                (*err) += std::string("Cannot open file [") + filename + "]\n";
+            }
+            return false;
+        }
+
+        // split the file on line boundaries, one chunk per worker
+        size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+        size_t chunkCount = std::max((size_t)1, std::min(threadCount, file.size() / OBJ_MIN_CHUNK_SIZE));
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char* data = file.data();
+        const char* end = data + file.size();
+        const char* begin = data;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char* split = (i + 1 == chunkCount) ? end : data + file.size() * (i + 1) / chunkCount;
+            if (split < begin) {
+                split = begin;
+            }
+            if (split < end) {
+                const char* newline = (const char*)memchr(split, '\n', end - split);
+                split = newline ? newline + 1 : end;
+            }
+            chunks[i].begin = begin;
+            chunks[i].end = split;
+            chunks[i].lastMaterial = OBJ_MATERIAL_INHERITED;
+            begin = split;
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < chunkCount; i++) {
+            workers.push_back(std::thread(countChunk, &chunks[i]));
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+        workers.clear();
+
+        size_t vertexCount = 0, normalCount = 0, texcoordCount = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+            chunks[i].vertexBase = vertexCount;
+            chunks[i].normalBase = normalCount;
+            chunks[i].texcoordBase = texcoordCount;
+            vertexCount += chunks[i].vertexCount;
+            normalCount += chunks[i].normalCount;
+            texcoordCount += chunks[i].texcoordCount;
+        }
+        attrib->vertices.resize(3 * vertexCount);
+        attrib->normals.resize(3 * normalCount);
+        attrib->texcoords.resize(2 * texcoordCount);
+
+        for (size_t i = 0; i < chunkCount; i++) {
+            workers.push_back(std::thread(parseChunk, &chunks[i], attrib, triangulate));
+        }
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+
+        // materials are loaded in file order once every chunk has reported its mtllib lines
+        std::map<std::string, int> materialMap;
+        tinyobj::MaterialFileReader materialReader(mtl_basepath ? mtl_basepath : "");
+        for (size_t i = 0; i < chunkCount; i++) {
+            for (size_t m = 0; m < chunks[i].materialLibraries.size(); m++) {
+                std::string materialError;
+                materialReader(chunks[i].materialLibraries[m], materials, &materialMap, &materialError);
+                if (err) {
+                    (*err) += materialError;
+                }
+            }
+        }
+
+        // stitch the segments together in file order, resolving material names to ids
+        tinyobj::shape_t shape;
+        int material = -1;
+        std::vector<int> materialIds;
+        for (size_t i = 0; i < chunkCount; i++) {
+            ObjChunk& chunk = chunks[i];
+
+            materialIds.resize(chunk.materialNames.size());
+            for (size_t m = 0; m < chunk.materialNames.size(); m++) {
+                std::map<std::string, int>::iterator it = materialMap.find(chunk.materialNames[m]);
+                materialIds[m] = (it != materialMap.end()) ? it->second : -1;
+            }
+
+            for (size_t s = 0; s < chunk.segments.size(); s++) {
+                ObjShapeSegment& segment = chunk.segments[s];
+                if (segment.startsShape) {
+                    if (!shape.mesh.indices.empty()) {
+                        shapes->push_back(shape);
+                    }
+                    shape = tinyobj::shape_t();
+                    shape.name = segment.name;
+                }
+
+                tinyobj::mesh_t& mesh = segment.mesh;
+                for (size_t f = 0; f < mesh.material_ids.size(); f++) {
+                    int slot = mesh.material_ids[f];
+                    mesh.material_ids[f] = (slot == OBJ_MATERIAL_INHERITED) ? material : materialIds[slot];
+                }
+                shape.mesh.indices.insert(shape.mesh.indices.end(), mesh.indices.begin(), mesh.indices.end());
+                shape.mesh.num_face_vertices.insert(shape.mesh.num_face_vertices.end(), mesh.num_face_vertices.begin(), mesh.num_face_vertices.end());
+                shape.mesh.material_ids.insert(shape.mesh.material_ids.end(), mesh.material_ids.begin(), mesh.material_ids.end());
+            }
+
+            if (chunk.lastMaterial != OBJ_MATERIAL_INHERITED) {
+                material = materialIds[chunk.lastMaterial];
+            }
+        }
+        if (!shape.mesh.indices.empty()) {
+            shapes->push_back(shape);
+        }
+
+        return true;
+    }
+}
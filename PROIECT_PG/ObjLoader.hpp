@@ -0,0 +1,21 @@
+#ifndef ObjLoader_hpp
+#define ObjLoader_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Drop-in replacement for tinyobj::LoadObj that maps the file and parses it on all cores.
+    // The file is split on line boundaries, every worker parses its chunk of v/vn/vt/f records
+    // straight into the shared attribute arrays and the per-chunk faces are merged into shapes
+    // in file order. Materials are read with tinyobj's MaterialFileReader.
+    bool LoadObjParallel(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+                         std::vector<tinyobj::material_t>* materials, std::string* err,
+                         const char* filename, const char* mtl_basepath = NULL,
+                         bool triangulate = true);
+}
+
+#endif /* ObjLoader_hpp */
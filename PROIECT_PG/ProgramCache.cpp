@@ -0,0 +1,141 @@
+#include "ProgramCache.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace gps {
+
+    static const char PROGRAM_CACHE_MAGIC[4] = {'G', 'P', 'S', 'P'};
+
+    struct ProgramCacheHeader {
+        char magic[4];
+        uint32_t version;
+        // sources and driver strings; a mismatch invalidates the cache
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+    };
+
+    static ProgramCacheStats stats;
+
+    // FNV-1a, 64 bit
+    static uint64_t hashBytes(const void* data, size_t size, uint64_t hash) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Hashes the string with its terminator, so "ab" + "c" and "a" + "bc" differ
+    static uint64_t hashString(const char* value, uint64_t hash) {
+        if (value == NULL) {
+            value = "";
+        }
+        return hashBytes(value, std::strlen(value) + 1, hash);
+    }
+
+    std::string ProgramCache::cachePathFor(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
+        char fragmentHash[17];
+        snprintf(fragmentHash, sizeof(fragmentHash), "%016llx",
+                 (unsigned long long)hashString(fragmentShaderFileName.c_str(), 14695981039346656037ull));
+        return vertexShaderFileName + "." + fragmentHash + ".programcache";
+    }
+
+    bool ProgramCache::isSupported() {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    uint64_t ProgramCache::keyFor(const std::string& vertexSource, const std::string& fragmentSource) {
+        uint64_t hash = 14695981039346656037ull;
+        hash = hashString(vertexSource.c_str(), hash);
+        hash = hashString(fragmentSource.c_str(), hash);
+        hash = hashString((const char*)glGetString(GL_VENDOR), hash);
+        hash = hashString((const char*)glGetString(GL_RENDERER), hash);
+        hash = hashString((const char*)glGetString(GL_VERSION), hash);
+        return hash;
+    }
+
+    GLuint ProgramCache::load(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint64_t key) {
+        std::ifstream in(cachePathFor(vertexShaderFileName, fragmentShaderFileName).c_str(), std::ios::binary);
+        ProgramCacheHeader header;
+        if (!in || !in.read((char*)&header, sizeof(header)) ||
+            std::memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != PROGRAM_CACHE_VERSION ||
+            header.key != key) {
+            stats.misses++;
+            return 0;
+        }
+
+        std::vector<char> binary(header.binaryLength);
+        if (!in.read(binary.data(), binary.size())) {
+            stats.misses++;
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            glDeleteProgram(program);
+            stats.rejected++;
+            stats.misses++;
+            return 0;
+        }
+
+        stats.hits++;
+        return program;
+    }
+
+    bool ProgramCache::store(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint64_t key, GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return false;
+        }
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0) {
+            return false;
+        }
+
+        ProgramCacheHeader header;
+        std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+        header.version = PROGRAM_CACHE_VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binaryLength = (uint32_t)written;
+
+        // written under a temporary name so a crash never leaves a truncated binary behind
+        std::string cachePath = cachePathFor(vertexShaderFileName, fragmentShaderFileName);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream out(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out) {
+            fprintf(stderr, "WARNING: could not write program cache %s\n", cachePath.c_str());
+            return false;
+        }
+        out.write((const char*)&header, sizeof(header));
+        out.write(binary.data(), written);
+        out.close();
+
+        if (!out || std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            fprintf(stderr, "WARNING: could not write program cache %s\n", cachePath.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    ProgramCacheStats ProgramCache::getStats() {
+        return stats;
+    }
+}
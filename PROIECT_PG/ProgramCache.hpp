@@ -0,0 +1,52 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // Bump whenever the on-disk layout changes
+    const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+    struct ProgramCacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        // cached binaries the driver refused, e.g. after a driver update with the same strings
+        size_t rejected = 0;
+    };
+
+    // Linked program binaries stored next to the vertex shader, one file per vertex and fragment
+    // shader pair, so later runs can skip
+    // compiling and linking. An entry is only used when the shader sources and the driver's
+    // vendor, renderer and version strings hash to the key it was written with.
+    // Must only be used from the thread that owns the GL context.
+    class ProgramCache
+    {
+    public:
+        // Returns the path of the cache file of a program; programs that share a vertex shader
+        // get different files through a hash of the fragment shader's path
+        static std::string cachePathFor(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+
+        // False when the driver offers no binary formats, as some 4.1 drivers do
+        static bool isSupported();
+
+        // Hash of both sources and the current driver
+        static uint64_t keyFor(const std::string& vertexSource, const std::string& fragmentSource);
+
+        // Returns a linked program built from the cached binary, or 0 on a miss or when the
+        // driver rejects the binary
+        static GLuint load(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint64_t key);
+
+        // Saves the binary of a linked program; the program must have been linked with
+        // GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+        static bool store(std::string vertexShaderFileName, std::string fragmentShaderFileName, uint64_t key, GLuint program);
+
+        static ProgramCacheStats getStats();
+    };
+}
+
+#endif /* ProgramCache_hpp */
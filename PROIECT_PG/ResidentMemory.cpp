@@ -0,0 +1,36 @@
+#include "ResidentMemory.hpp"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <cstdio>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+    size_t residentMemoryBytes() {
+#if defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+            return 0;
+        }
+        return (size_t)info.resident_size;
+#else
+        // second field of statm is the resident page count
+        FILE* statm = std::fopen("/proc/self/statm", "r");
+        if (statm == NULL) {
+            return 0;
+        }
+        unsigned long size = 0;
+        unsigned long resident = 0;
+        int fields = std::fscanf(statm, "%lu %lu", &size, &resident);
+        std::fclose(statm);
+        if (fields != 2) {
+            return 0;
+        }
+        return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+}
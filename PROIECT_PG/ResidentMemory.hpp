@@ -0,0 +1,12 @@
+#ifndef ResidentMemory_hpp
+#define ResidentMemory_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Resident set size of the process in bytes; 0 if the platform does not report it
+    size_t residentMemoryBytes();
+}
+
+#endif /* ResidentMemory_hpp */
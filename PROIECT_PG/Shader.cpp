@@ -1,4 +1,12 @@
 #include "Shader.hpp"
+#include "ProgramCache.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 
 namespace gps {
     std::string Shader::readShaderFile(std::string fileName)
@@ -36,7 +44,7 @@ namespace gps {
         }
     }
 
-    void Shader::shaderLinkLog(GLuint shaderProgramId)
+    GLint Shader::shaderLinkLog(GLuint shaderProgramId)
     {
         GLint success;
         GLchar infoLog[512];
@@ -47,43 +55,245 @@ namespace gps {
             glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success;
     }
 
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
+        loadShaderAsync(vertexShaderFileName, fragmentShaderFileName);
+        wait();
+    }
+
+    // Lets the driver compile on its own threads; without the extension compiling blocks in wait()
+    static bool enableParallelCompile()
+    {
+        static bool enabled = false;
+        static bool checked = false;
+        if (!checked) {
+            checked = true;
+            if (GLEW_KHR_parallel_shader_compile) {
+                glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+                enabled = true;
+            } else if (GLEW_ARB_parallel_shader_compile) {
+                glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+                enabled = true;
+            }
+        }
+        return enabled;
+    }
+
+    void Shader::loadShaderAsync(std::string vertexShaderFileName, std::string fragmentShaderFileName)
+    {
+        pending.active = true;
+        pending.start = std::chrono::steady_clock::now();
+        pending.vertexShaderFileName = vertexShaderFileName;
+        pending.fragmentShaderFileName = fragmentShaderFileName;
+        pending.vertexShader = 0;
+        pending.fragmentShader = 0;
+
         std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
         std::string f = readShaderFile(fragmentShaderFileName);
+
+        //a binary linked by an earlier run with the same sources and driver skips compiling
+        pending.useCache = ProgramCache::isSupported();
+        pending.cacheKey = pending.useCache ? ProgramCache::keyFor(v, f) : 0;
+        this->shaderProgram = pending.useCache ? ProgramCache::load(vertexShaderFileName, fragmentShaderFileName, pending.cacheKey) : 0;
+        pending.cacheHit = this->shaderProgram != 0;
+        if (pending.cacheHit) {
+            return;
+        }
+
+        enableParallelCompile();
+
+        //parse and compile the vertex shader
+        const GLchar* vertexShaderString = v.c_str();
+        pending.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(pending.vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(pending.vertexShader);
+
+        //parse and compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
-
-        //attach and link the shader programs
+        pending.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(pending.fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(pending.fragmentShader);
+
+        //attach and link the shader programs; no status is queried here, that would wait for the driver
         this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        glAttachShader(this->shaderProgram, pending.vertexShader);
+        glAttachShader(this->shaderProgram, pending.fragmentShader);
+        if (pending.useCache) {
+            glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+    }
+
+    bool Shader::isReady()
+    {
+        if (!pending.active || pending.cacheHit || !enableParallelCompile()) {
+            return true;
+        }
+        GLint done = GL_FALSE;
+        glGetProgramiv(this->shaderProgram, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    void Shader::wait()
+    {
+        if (!pending.active) {
+            return;
+        }
+        pending.active = false;
+
+        if (!pending.cacheHit) {
+            //check compilation status
+            shaderCompileLog(pending.vertexShader);
+            shaderCompileLog(pending.fragmentShader);
+            glDeleteShader(pending.vertexShader);
+            glDeleteShader(pending.fragmentShader);
+            //check linking info
+            GLint linked = shaderLinkLog(this->shaderProgram);
+
+            if (pending.useCache && linked) {
+                ProgramCache::store(pending.vertexShaderFileName, pending.fragmentShaderFileName, pending.cacheKey, this->shaderProgram);
+            }
+        }
+
+        reflectUniforms();
+        bindUniformBlocks();
+
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.start).count();
+        std::cout << "Shader " << pending.vertexShaderFileName << " : "
+            << (pending.cacheHit ? "cache hit" : pending.useCache ? "cache miss" : "no binary cache")
+            << ", ready " << loadMs << " ms after submission" << std::endl;
+    }
+
+    void Shader::bindUniformBlocks()
+    {
+        uniformBlocks = 0;
+        for (int binding = 0; binding < UNIFORM_BINDING_COUNT; binding++) {
+            GLuint index = glGetUniformBlockIndex(this->shaderProgram, uniformBlockName((UniformBlockBinding)binding));
+            if (index == GL_INVALID_INDEX) {
+                continue;
+            }
+            glUniformBlockBinding(this->shaderProgram, index, (GLuint)binding);
+            uniformBlocks |= 1u << binding;
+        }
+    }
+
+    bool Shader::hasUniformBlock(UniformBlockBinding binding)
+    {
+        return (uniformBlocks & (1u << binding)) != 0;
+    }
+
+    void Shader::reflectUniforms()
+    {
+        uniforms.clear();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+            std::string uniformName(name.data(), length);
+
+            // arrays are reported as "name[0]"; they are addressed by their plain name
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+                uniformName.resize(uniformName.size() - 3);
+            }
+
+            // uniforms inside blocks have no location
+            GLint location = glGetUniformLocation(this->shaderProgram, uniformName.c_str());
+            if (location < 0) {
+                continue;
+            }
+
+            Uniform uniform;
+            uniform.hash = hashUniformName(uniformName.c_str());
+            uniform.location = location;
+            uniform.hasValue = false;
+            std::memset(uniform.value, 0, sizeof(uniform.value));
+            uniforms.push_back(uniform);
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const Uniform& a, const Uniform& b) {
+            return a.hash < b.hash;
+        });
+        for (size_t i = 1; i < uniforms.size(); i++) {
+            if (uniforms[i].hash == uniforms[i - 1].hash) {
+                fprintf(stderr, "ERROR: two uniforms of program %u have the same name hash\n", this->shaderProgram);
+            }
+        }
+    }
+
+    GLint Shader::getUniformLocation(UniformName name)
+    {
+        std::vector<Uniform>::iterator it = std::lower_bound(uniforms.begin(), uniforms.end(), name.hash,
+            [](const Uniform& uniform, uint32_t hash) { return uniform.hash < hash; });
+        if (it == uniforms.end() || it->hash != name.hash) {
+            return -1;
+        }
+        return it->location;
+    }
+
+    Shader::Uniform* Shader::changedUniform(UniformName name, const void* value, size_t bytes)
+    {
+        std::vector<Uniform>::iterator it = std::lower_bound(uniforms.begin(), uniforms.end(), name.hash,
+            [](const Uniform& uniform, uint32_t hash) { return uniform.hash < hash; });
+        if (it == uniforms.end() || it->hash != name.hash) {
+            return NULL;
+        }
+        if (it->hasValue && std::memcmp(it->value, value, bytes) == 0) {
+            return NULL;
+        }
+        std::memcpy(it->value, value, bytes);
+        it->hasValue = true;
+        return &*it;
+    }
+
+    void Shader::setInt(UniformName name, GLint value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value))) {
+            glUniform1i(uniform->location, value);
+        }
+    }
+
+    void Shader::setFloat(UniformName name, GLfloat value)
+    {
+        if (Uniform* uniform = changedUniform(name, &value, sizeof(value))) {
+            glUniform1f(uniform->location, value);
+        }
+    }
+
+    void Shader::setVec3(UniformName name, const glm::vec3& value)
+    {
+        if (Uniform* uniform = changedUniform(name, glm::value_ptr(value), sizeof(glm::vec3))) {
+            glUniform3fv(uniform->location, 1, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat3(UniformName name, const glm::mat3& value)
+    {
+        if (Uniform* uniform = changedUniform(name, glm::value_ptr(value), sizeof(glm::mat3))) {
+            glUniformMatrix3fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        }
+    }
+
+    void Shader::setMat4(UniformName name, const glm::mat4& value)
+    {
+        if (Uniform* uniform = changedUniform(name, glm::value_ptr(value), sizeof(glm::mat4))) {
+            glUniformMatrix4fv(uniform->location, 1, GL_FALSE, glm::value_ptr(value));
+        }
     }
 
     void Shader::useShaderProgram()
     {
+        wait();
         glUseProgram(this->shaderProgram);
     }
 
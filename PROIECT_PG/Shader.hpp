@@ -2,26 +2,111 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include "glm/glm.hpp"
 
+#include "UniformBuffers.hpp"
+
+#include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace gps {
 
+// FNV-1a hash of a uniform name
+constexpr uint32_t hashUniformName(const char* name, uint32_t hash = 2166136261u)
+{
+    return *name == '\0' ? hash : hashUniformName(name + 1, (hash ^ (uint8_t)*name) * 16777619u);
+}
+
+// Uniform name reduced to its hash. Declare the names as constexpr constants so the compiler
+// does the hashing and no string is touched while drawing.
+struct UniformName
+{
+    uint32_t hash;
+    constexpr UniformName(const char* name) : hash(hashUniformName(name)) {}
+};
+
 class Shader
 {
 public:
     GLuint shaderProgram;
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+
+    // Submits the compile and link and returns without waiting for the driver. With
+    // KHR_parallel_shader_compile the driver works on its own threads, so several programs
+    // can be submitted before any of them is waited on.
+    void loadShaderAsync(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+
+    // True once the driver has finished the load. Without the extension it cannot tell and
+    // returns true, so polling callers go on to wait() and block there.
+    bool isReady();
+
+    // Finishes a submitted load: checks the logs, stores the binary and reflects the uniforms.
+    // Does nothing if no load is pending; useShaderProgram() calls it.
+    void wait();
+
     void useShaderProgram();
 
+    // Location of an active uniform from the table built at link time; -1 if the program has none
+    GLint getUniformLocation(UniformName name);
+
+    // Upload a uniform unless it already holds the value, as far as this shader knows.
+    // The program has to be in use; uniforms the program does not have are ignored like in GL.
+    void setInt(UniformName name, GLint value);
+    void setFloat(UniformName name, GLfloat value);
+    void setVec3(UniformName name, const glm::vec3& value);
+    void setMat3(UniformName name, const glm::mat3& value);
+    void setMat4(UniformName name, const glm::mat4& value);
+
+    // True if the program declares the shared block of that binding point; programs without it
+    // need the same values as plain uniforms
+    bool hasUniformBlock(UniformBlockBinding binding);
+
 private:
+    // A load between loadShaderAsync() and wait()
+    struct PendingLoad {
+        bool active = false;
+        bool useCache = false;
+        bool cacheHit = false;
+        uint64_t cacheKey = 0;
+        GLuint vertexShader = 0;
+        GLuint fragmentShader = 0;
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        std::chrono::steady_clock::time_point start;
+    };
+    PendingLoad pending;
+
+    // One active uniform and the last value uploaded through the setters
+    struct Uniform {
+        uint32_t hash;
+        GLint location;
+        bool hasValue;
+        GLfloat value[16];
+    };
+    // sorted by hash
+    std::vector<Uniform> uniforms;
+    // one bit per UniformBlockBinding the program uses
+    uint32_t uniformBlocks = 0;
+
     std::string readShaderFile(std::string fileName);
     void shaderCompileLog(GLuint shaderId);
-    void shaderLinkLog(GLuint shaderProgramId);
+    // Prints the link log on failure; returns GL_LINK_STATUS
+    GLint shaderLinkLog(GLuint shaderProgramId);
+
+    // Reads the active uniforms of the linked program into the table
+    void reflectUniforms();
+
+    // Attaches the shared uniform blocks the program declares to their binding points
+    void bindUniformBlocks();
+
+    // Returns the uniform if it exists and value differs from its shadow copy, updating the copy
+    Uniform* changedUniform(UniformName name, const void* value, size_t bytes);
 };
 
 }
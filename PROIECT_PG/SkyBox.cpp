@@ -21,20 +21,27 @@ namespace gps {
         InitSkyBox();
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    static constexpr UniformName VIEW_UNIFORM("view");
+    static constexpr UniformName PROJECTION_UNIFORM("projection");
+    static constexpr UniformName SKYBOX_UNIFORM("skybox");
+
+    void SkyBox::Draw(gps::Shader& shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
     {
         shader.useShaderProgram();
         
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        //set the view and projection matrices, unless the shader reads them from the frame block
+        //and drops the translation itself
+        if (!shader.hasUniformBlock(FRAME_UNIFORM_BINDING)) {
+            glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
+            shader.setMat4(VIEW_UNIFORM, transformedView);
+            shader.setMat4(PROJECTION_UNIFORM, projectionMatrix);
+        }
         
         glDepthFunc(GL_LEQUAL);
         
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
+        shader.setInt(SKYBOX_UNIFORM, 0);
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
@@ -42,27 +49,29 @@ namespace gps {
         glDepthFunc(GL_LESS);
     }
     
+    // Decoded faces are collected here and uploaded together so the cube map
+    // never mixes placeholder and full size faces
+    struct SkyBoxFaces {
+        GLuint textureID;
+        std::vector<DecodedImage> images;
+        size_t arrived;
+    };
+
     GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
     {
         GLuint textureID;
         glGenTextures(1, &textureID);
         glActiveTexture(GL_TEXTURE0);
         
-        int width,height, n;
-        unsigned char* image;
-        int force_channels = 3;
+        // 1x1 placeholder faces keep the cube map complete until the images are decoded
+        static const unsigned char placeholder[3] = {0, 0, 0};
         
         glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
         for(GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
-                return false;
-            }
             glTexImage2D(
                          GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
+                         GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder
                          );
         }
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -72,6 +81,38 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         
+        std::shared_ptr<SkyBoxFaces> faces = std::make_shared<SkyBoxFaces>();
+        faces->textureID = textureID;
+        faces->images.resize(skyBoxFaces.size());
+        faces->arrived = 0;
+        
+        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
+        {
+            TextureLoader::instance().request(skyBoxFaces[i], 3, false, [faces, i](const DecodedImage& image) {
+                faces->images[i] = image;
+                if (++faces->arrived < faces->images.size()) {
+                    return;
+                }
+                
+                for (size_t f = 0; f < faces->images.size(); f++) {
+                    if (!faces->images[f].pixels) {
+                        // the loader already reported the error; keep the placeholder faces
+                        return;
+                    }
+                }
+                
+                glBindTexture(GL_TEXTURE_CUBE_MAP, faces->textureID);
+                for (GLuint f = 0; f < faces->images.size(); f++) {
+                    glTexImage2D(
+                                 GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0,
+                                 GL_RGB, faces->images[f].width, faces->images[f].height, 0, GL_RGB, GL_UNSIGNED_BYTE, faces->images[f].pixels.get()
+                                 );
+                }
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+                faces->images.clear();
+            });
+        }
+        
         return textureID;
     }
     
@@ -0,0 +1,123 @@
+#include "StagingPool.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    // Smallest class is 256 bytes, the largest 1 GiB
+    static const int STAGING_MIN_CLASS = 8;
+    static const int STAGING_MAX_CLASS = 30;
+    // Free blocks above this total are returned to the system
+    static const size_t STAGING_MAX_CACHED_BYTES = 256 * 1024 * 1024;
+
+    // Every block starts with its size class; 16 bytes keep the payload aligned
+    struct StagingHeader {
+        size_t sizeClass;
+        size_t padding;
+    };
+
+    struct StagingPoolState {
+        std::mutex mutex;
+        std::vector<void*> freeLists[STAGING_MAX_CLASS + 1];
+        StagingPoolStats stats;
+    };
+
+    // Never destroyed: decoded images may still be freed by other static destructors
+    static StagingPoolState& poolState() {
+        static StagingPoolState* state = new StagingPoolState();
+        return *state;
+    }
+
+    static size_t sizeClassFor(size_t size) {
+        size_t sizeClass = STAGING_MIN_CLASS;
+        while (((size_t)1 << sizeClass) < size) {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    static StagingHeader* headerOf(void* block) {
+        return (StagingHeader*)block - 1;
+    }
+
+    void* stagingAlloc(size_t size) {
+        size_t sizeClass = sizeClassFor(size);
+        if (sizeClass > STAGING_MAX_CLASS) {
+            return NULL;
+        }
+        size_t classBytes = (size_t)1 << sizeClass;
+
+        StagingPoolState& state = poolState();
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stats.bytesInUse += classBytes;
+            if (!state.freeLists[sizeClass].empty()) {
+                void* block = state.freeLists[sizeClass].back();
+                state.freeLists[sizeClass].pop_back();
+                state.stats.bytesCached -= classBytes;
+                state.stats.reused++;
+                return block;
+            }
+            state.stats.allocated++;
+        }
+
+        StagingHeader* header = (StagingHeader*)malloc(sizeof(StagingHeader) + classBytes);
+        if (!header) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stats.bytesInUse -= classBytes;
+            return NULL;
+        }
+        header->sizeClass = sizeClass;
+        return header + 1;
+    }
+
+    void* stagingRealloc(void* block, size_t size) {
+        if (!block) {
+            return stagingAlloc(size);
+        }
+
+        size_t sizeClass = headerOf(block)->sizeClass;
+        if (size <= ((size_t)1 << sizeClass)) {
+            // still fits in its class
+            return block;
+        }
+
+        void* grown = stagingAlloc(size);
+        if (!grown) {
+            return NULL;
+        }
+        std::memcpy(grown, block, (size_t)1 << sizeClass);
+        stagingFree(block);
+        return grown;
+    }
+
+    void stagingFree(void* block) {
+        if (!block) {
+            return;
+        }
+
+        StagingHeader* header = headerOf(block);
+        size_t classBytes = (size_t)1 << header->sizeClass;
+
+        StagingPoolState& state = poolState();
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.stats.bytesInUse -= classBytes;
+            if (state.stats.bytesCached + classBytes <= STAGING_MAX_CACHED_BYTES) {
+                state.freeLists[header->sizeClass].push_back(block);
+                state.stats.bytesCached += classBytes;
+                return;
+            }
+        }
+        free(header);
+    }
+
+    StagingPoolStats getStagingPoolStats() {
+        StagingPoolState& state = poolState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        return state.stats;
+    }
+}
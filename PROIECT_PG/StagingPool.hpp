@@ -0,0 +1,27 @@
+#ifndef StagingPool_hpp
+#define StagingPool_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    struct StagingPoolStats {
+        // requests served from a recycled block vs. fresh mallocs
+        size_t reused = 0;
+        size_t allocated = 0;
+        // bytes currently handed out / parked in the free lists
+        size_t bytesInUse = 0;
+        size_t bytesCached = 0;
+    };
+
+    // Thread-safe pool of power-of-two sized blocks used for image decode buffers.
+    // stb_image allocates through it, so the pixels of one texture are decoded
+    // into the block freed by the previous texture of the same size class.
+    void* stagingAlloc(size_t size);
+    void* stagingRealloc(void* block, size_t size);
+    void stagingFree(void* block);
+
+    StagingPoolStats getStagingPoolStats();
+}
+
+#endif /* StagingPool_hpp */
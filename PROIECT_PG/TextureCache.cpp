@@ -0,0 +1,374 @@
+#include "TextureCache.hpp"
+
+#include "ImageKernels.hpp"
+#include "StagingPool.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+
+namespace gps {
+
+    TextureCache::TextureCache() {
+        // color maps get the slower principal axis encoder, the rest favour bake speed
+        TextureBakeSettings diffuse = {BAKED_FORMAT_BC1, BLOCK_QUALITY_HIGH};
+        TextureBakeSettings ambient = {BAKED_FORMAT_BC1, BLOCK_QUALITY_FAST};
+        TextureBakeSettings specular = {BAKED_FORMAT_BC1, BLOCK_QUALITY_FAST};
+        bakeSettings["diffuseTexture"] = diffuse;
+        bakeSettings["ambientTexture"] = ambient;
+        bakeSettings["specularTexture"] = specular;
+    }
+
+    void TextureCache::setBakeSettings(std::string type, TextureBakeSettings settings) {
+        bakeSettings[type] = settings;
+    }
+
+    TextureBakeSettings TextureCache::getBakeSettings(std::string type) {
+        auto found = bakeSettings.find(type);
+        if (found == bakeSettings.end()) {
+            TextureBakeSettings uncompressed = {BAKED_FORMAT_RGBA8, BLOCK_QUALITY_HIGH};
+            return uncompressed;
+        }
+        return found->second;
+    }
+
+    bool TextureCache::isFormatSupported(BakedTextureFormat format) {
+        switch (format) {
+            case BAKED_FORMAT_BC1:
+            case BAKED_FORMAT_BC3:
+                return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+            case BAKED_FORMAT_BC5:
+                // RGTC is core since OpenGL 3.0
+                return true;
+            default:
+                return true;
+        }
+    }
+
+    // Never destroyed: global models release their textures during static destruction
+    TextureCache& TextureCache::instance() {
+        static TextureCache* cache = new TextureCache();
+        return *cache;
+    }
+
+    std::string TextureCache::canonicalPath(std::string path) {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved) == NULL) {
+            // missing files keep their spelling; the load will report the error
+            return path;
+        }
+        return std::string(resolved);
+    }
+
+    TextureColorSpace TextureCache::colorSpaceFor(std::string type) {
+        return type == "specularTexture" ? TEXTURE_COLOR_LINEAR : TEXTURE_COLOR_SRGB;
+    }
+
+    std::string TextureCache::entryKey(std::string path, TextureColorSpace colorSpace) {
+        // a newline cannot be part of a path taken from an .mtl file
+        return path + (colorSpace == TEXTURE_COLOR_LINEAR ? "\nlinear" : "\nsrgb");
+    }
+
+    GLuint TextureCache::acquire(std::string path, std::string type) {
+        std::string canonical = canonicalPath(path);
+        TextureColorSpace colorSpace = colorSpaceFor(type);
+        std::string key = entryKey(canonical, colorSpace);
+
+        auto found = entries.find(key);
+        if (found != entries.end()) {
+            found->second.refCount++;
+            stats.referenceCount++;
+            stats.hits++;
+            return found->second.texture.get();
+        }
+
+        Entry entry;
+        entry.path = canonical;
+        entry.colorSpace = colorSpace;
+        entry.bytes = 0;
+        entry.width = 0;
+        entry.height = 0;
+        entry.internalFormat = GL_RGBA8;
+        entry.refCount = 1;
+        entry.texture = genTexture();
+        GLuint textureID = entry.texture.get();
+
+        stats.textureCount++;
+        stats.referenceCount++;
+        stats.misses++;
+
+        TextureBakeSettings settings = getBakeSettings(type);
+        if (!isFormatSupported(settings.format)) {
+            settings.format = BAKED_FORMAT_RGBA8;
+        }
+
+        // a baked file only needs to be mapped and uploaded, no decode or mip generation
+        BakedTexture baked;
+        if (baked.open(canonical, colorSpace, settings.format, settings.quality) && ReadTextureFromBaked(textureID, baked, &entry)) {
+            stats.gpuBytes += entry.bytes;
+            stats.bakedCount++;
+            entries[key] = std::move(entry);
+            return textureID;
+        }
+        entries[key] = std::move(entry);
+
+        // neutral grey until the decoded image is uploaded over it
+        static const unsigned char placeholder[4] = {128, 128, 128, 255};
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        TextureLoader::instance().request(canonical, 0, true, [this, key, settings, textureID](const DecodedImage& image) {
+            onDecoded(key, settings, textureID, image);
+        }, [canonical, colorSpace, settings](const DecodedImage& image) {
+            // bake on the worker so the next run can skip the decode
+            BakedTexture::write(canonical, image.pixels.get(), image.width, image.height, image.channels, colorSpace,
+                                settings.format, settings.quality);
+        });
+
+        return textureID;
+    }
+
+    void TextureCache::onDecoded(std::string key, TextureBakeSettings settings, GLuint textureID, const DecodedImage& image) {
+        auto found = entries.find(key);
+        if (found == entries.end() || found->second.texture.get() != textureID) {
+            // released before the decode finished
+            return;
+        }
+        if (!image.pixels) {
+            // the loader already reported the error; keep the placeholder
+            return;
+        }
+
+        // the worker has just baked the image, so its mip chain is usually ready in the page cache
+        BakedTexture baked;
+        if (!baked.open(found->second.path, found->second.colorSpace, settings.format, settings.quality) ||
+            !ReadTextureFromBaked(textureID, baked, &found->second)) {
+            ReadTextureFromImage(textureID, image, &found->second);
+        }
+        stats.gpuBytes += found->second.bytes;
+    }
+
+    void TextureCache::release(std::string path, std::string type) {
+        auto found = entries.find(entryKey(canonicalPath(path), colorSpaceFor(type)));
+        if (found == entries.end()) {
+            return;
+        }
+
+        stats.referenceCount--;
+        if (--found->second.refCount > 0) {
+            return;
+        }
+
+        // erasing the entry deletes the texture
+        stats.textureCount--;
+        stats.gpuBytes -= found->second.bytes;
+        entries.erase(found);
+    }
+
+    TextureCacheStats TextureCache::getStats() {
+        TextureCacheStats current = stats;
+        current.savedBytes = 0;
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            current.savedBytes += (it->second.refCount - 1) * it->second.bytes;
+        }
+        return current;
+    }
+
+    static bool isOpaque(const unsigned char* pixels, int width, int height, int channels) {
+        for (size_t i = 0; i < (size_t)width * height; i++) {
+            if (pixels[i * channels + channels - 1] != 255) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Color maps stay sRGB and only keep alpha if they use it; specular maps are single channel linear data
+    static GLenum internalFormatFor(const unsigned char* pixels, int width, int height, int channels, TextureColorSpace colorSpace) {
+        if (colorSpace == TEXTURE_COLOR_LINEAR) {
+            return GL_R8;
+        }
+        if (channels == 2 || channels == 4) {
+            return isOpaque(pixels, width, height, channels) ? GL_SRGB8 : GL_SRGB8_ALPHA8;
+        }
+        return GL_SRGB8;
+    }
+
+    static size_t bytesPerPixel(GLenum internalFormat) {
+        switch (internalFormat) {
+            case GL_R8: return 1;
+            // RGB8 formats are padded to 4 bytes by most drivers
+            default: return 4;
+        }
+    }
+
+    static const char* formatName(GLenum internalFormat) {
+        switch (internalFormat) {
+            case GL_R8: return "R8";
+            case GL_RGBA8: return "RGBA8";
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "BC1";
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return "BC3";
+            case GL_SRGB8: return "SRGB8";
+            case GL_SRGB8_ALPHA8: return "SRGB8_ALPHA8";
+            case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT: return "BC1_SRGB";
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT: return "BC3_SRGB";
+            case GL_COMPRESSED_RG_RGTC2: return "BC5";
+            default: return "unknown";
+        }
+    }
+
+    void TextureCache::printReport() {
+        size_t totalBytes = 0;
+        size_t totalRGBABytes = 0;
+        std::cout << "Texture memory report:" << std::endl;
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            const Entry& entry = it->second;
+            // what the texture used to cost as RGBA8 with a full mip chain
+            size_t rgbaBytes = (size_t)entry.width * entry.height * 4 * 4 / 3;
+            totalBytes += entry.bytes;
+            totalRGBABytes += rgbaBytes;
+            std::cout << "  " << entry.path << " (" << (entry.colorSpace == TEXTURE_COLOR_LINEAR ? "linear" : "sRGB") << ") : " << entry.width << "x" << entry.height << " "
+                << formatName(entry.internalFormat) << ", " << entry.bytes << " bytes (RGBA8 " << rgbaBytes << "), "
+                << entry.refCount << " references" << std::endl;
+        }
+
+        StagingPoolStats pool = getStagingPoolStats();
+        std::cout << "  total " << totalBytes << " bytes, " << (totalRGBABytes - std::min(totalBytes, totalRGBABytes))
+            << " bytes saved against RGBA8" << std::endl;
+        std::cout << "  decode staging: " << pool.reused << " buffers reused, " << pool.allocated << " allocated, "
+            << pool.bytesCached << " bytes pooled" << std::endl;
+    }
+
+    // Uploads every level of a baked texture into an existing texture
+    bool TextureCache::ReadTextureFromBaked(GLuint textureID, BakedTexture& baked, Entry* entry) {
+        BakedTextureFormat format = baked.getFormat();
+        if (!isFormatSupported(format)) {
+            return false;
+        }
+
+        const std::vector<BakedTextureLevel>& levels = baked.getLevels();
+
+        // specular maps are linear data, like the R8 upload of decoded images
+        bool srgb = entry->colorSpace == TEXTURE_COLOR_SRGB;
+        GLenum internalFormat;
+        switch (format) {
+            case BAKED_FORMAT_BC1: internalFormat = srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+            case BAKED_FORMAT_BC3: internalFormat = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+            case BAKED_FORMAT_BC5: internalFormat = GL_COMPRESSED_RG_RGTC2; break;
+            default: internalFormat = internalFormatFor(levels[0].data, levels[0].width, levels[0].height, 4, entry->colorSpace); break;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        if (internalFormat == GL_R8) {
+            // sampled as grey so the shaders keep reading .rgb
+            GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+        for (size_t i = 0; i < levels.size(); i++) {
+            if (format == BAKED_FORMAT_RGBA8) {
+                glTexImage2D(
+                    GL_TEXTURE_2D,
+                    (GLint)i,
+                    internalFormat,
+                    levels[i].width,
+                    levels[i].height,
+                    0,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    levels[i].data
+                );
+            } else {
+                glCompressedTexImage2D(
+                    GL_TEXTURE_2D,
+                    (GLint)i,
+                    internalFormat,
+                    levels[i].width,
+                    levels[i].height,
+                    0,
+                    (GLsizei)levels[i].size,
+                    levels[i].data
+                );
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        entry->bytes = format == BAKED_FORMAT_RGBA8 ? (size_t)levels[0].width * levels[0].height * bytesPerPixel(internalFormat) * 4 / 3 : baked.getTotalBytes();
+        entry->width = (int)levels[0].width;
+        entry->height = (int)levels[0].height;
+        entry->internalFormat = internalFormat;
+        return true;
+    }
+
+    // Loads decoded pixel data into the video memory of an existing texture
+    void TextureCache::ReadTextureFromImage(GLuint textureID, const DecodedImage& image, Entry* entry) {
+        int x = image.width;
+        int y = image.height;
+        // NPOT check
+        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+            fprintf(
+                stderr, "WARNING: texture %s is not power-of-2 dimensions\n", image.path.c_str()
+            );
+        }
+
+        GLenum internalFormat = internalFormatFor(image.pixels.get(), x, y, image.channels, entry->colorSpace);
+        const unsigned char* pixels = image.pixels.get();
+        int channels = image.channels;
+
+        // there is no single channel sRGB format, so grey color maps are widened to RGBA here
+        std::vector<unsigned char> widened;
+        if (internalFormat != GL_R8 && channels <= 2) {
+            widened.resize((size_t)x * y * 4);
+            convertToRGBA(pixels, channels, widened.data(), (size_t)x * y);
+            pixels = widened.data();
+            channels = 4;
+        }
+
+        static const GLenum pixelFormats[5] = {GL_RGBA, GL_RED, GL_RG, GL_RGB, GL_RGBA};
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        if (internalFormat == GL_R8) {
+            // sampled as grey so the shaders keep reading .rgb
+            GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+            glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        }
+        // rows of 1 and 3 channel images are not padded to 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            internalFormat,
+            x,
+            y,
+            0,
+            pixelFormats[channels],
+            GL_UNSIGNED_BYTE,
+            pixels
+        );
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // base level plus a third for the mip chain
+        entry->bytes = (size_t)x * y * bytesPerPixel(internalFormat) * 4 / 3;
+        entry->width = x;
+        entry->height = y;
+        entry->internalFormat = internalFormat;
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef TextureCache_hpp
+#define TextureCache_hpp
+
+#include <GL/glew.h>
+
+#include "BakedTexture.hpp"
+#include "GLHandle.hpp"
+#include "TextureLoader.hpp"
+
+#include <string>
+#include <unordered_map>
+
+namespace gps {
+
+    // Totals of the texture cache; savedBytes is the video memory not spent on duplicate uploads
+    struct TextureCacheStats {
+        size_t textureCount = 0;
+        size_t referenceCount = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+        // textures uploaded straight from a baked file
+        size_t bakedCount = 0;
+        size_t gpuBytes = 0;
+        size_t savedBytes = 0;
+    };
+
+    // How textures of one material role ("diffuseTexture", ...) are baked
+    struct TextureBakeSettings {
+        BakedTextureFormat format;
+        BlockQuality quality;
+    };
+
+    // Process-wide registry of 2D textures keyed by canonical file path and color space, since
+    // the same image is uploaded with different internal formats as a color and as a data map.
+    // Every image is decoded and uploaded once per color space; each acquire() adds a reference
+    // and the GL texture is deleted when the last reference is released.
+    // Images with an up to date baked file are uploaded straight from it. Others are
+    // decoded (and baked for the next run) by the TextureLoader pool; until the pixels
+    // arrive the texture holds a 1x1 placeholder, so its id can be used right away.
+    // Must only be used from the thread that owns the GL context.
+    class TextureCache
+    {
+    public:
+        static TextureCache& instance();
+
+        // Returns the texture of an image file, queueing its decode on the first request.
+        // type selects the color space, and the bake settings if the image has to be baked.
+        GLuint acquire(std::string path, std::string type = "");
+
+        // Drops one reference to the texture acquired with the same path and type
+        void release(std::string path, std::string type = "");
+
+        TextureCacheStats getStats();
+
+        // Prints size, internal format and video memory of every texture against plain RGBA8
+        void printReport();
+
+        // Selects the format and encoder quality used when baking textures of a material role
+        void setBakeSettings(std::string type, TextureBakeSettings settings);
+
+        // Unknown roles are baked as uncompressed RGBA8
+        TextureBakeSettings getBakeSettings(std::string type);
+
+        // Resolves relative components and links so one image always maps to one key
+        static std::string canonicalPath(std::string path);
+
+        // Specular maps hold linear data, every other role is an sRGB color map
+        static TextureColorSpace colorSpaceFor(std::string type);
+
+    private:
+        struct Entry {
+            TextureHandle texture;
+            std::string path;
+            TextureColorSpace colorSpace;
+            size_t refCount;
+            // filled in by the upload; zero while the placeholder is bound
+            size_t bytes;
+            int width;
+            int height;
+            GLenum internalFormat;
+        };
+
+        std::unordered_map<std::string, Entry> entries;
+        std::unordered_map<std::string, TextureBakeSettings> bakeSettings;
+        TextureCacheStats stats;
+
+        TextureCache();
+        TextureCache(const TextureCache&);
+        TextureCache& operator=(const TextureCache&);
+
+        // Uploads every level of a baked texture into an existing texture;
+        // fails if the driver cannot sample the stored format
+        static bool ReadTextureFromBaked(GLuint textureID, BakedTexture& baked, Entry* entry);
+
+        // Loads decoded pixel data into the video memory of an existing texture,
+        // with an internal format picked from the channel count and the entry's color space
+        static void ReadTextureFromImage(GLuint textureID, const DecodedImage& image, Entry* entry);
+
+        // Key of the entry of an image in a color space
+        static std::string entryKey(std::string path, TextureColorSpace colorSpace);
+
+        // Whether the driver can sample a baked format
+        static bool isFormatSupported(BakedTextureFormat format);
+
+        // Called on the GL thread once the pixels of an entry have been decoded
+        void onDecoded(std::string key, TextureBakeSettings settings, GLuint textureID, const DecodedImage& image);
+    };
+}
+
+#endif /* TextureCache_hpp */
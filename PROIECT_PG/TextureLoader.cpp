@@ -0,0 +1,177 @@
+#include "TextureLoader.hpp"
+#include "ImageKernels.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace gps {
+
+    TextureLoader& TextureLoader::instance() {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    TextureLoader::TextureLoader() : pending(0), stopping(false) {
+        unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+        }
+    }
+
+    TextureLoader::~TextureLoader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        jobReady.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    void TextureLoader::request(std::string path, int forceChannels, bool flipVertically, UploadCallback onDecoded,
+                                WorkerStep afterDecode) {
+        Job job;
+        job.path = path;
+        job.forceChannels = forceChannels;
+        job.flipVertically = flipVertically;
+        job.onDecoded = onDecoded;
+        job.afterDecode = afterDecode;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+            pending++;
+        }
+        jobReady.notify_one();
+    }
+
+    void TextureLoader::processUploads() {
+        std::deque<Result> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.swap(results);
+        }
+
+        for (size_t i = 0; i < finished.size(); i++) {
+            finished[i].onDecoded(finished[i].image);
+        }
+
+        if (!finished.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending -= finished.size();
+        }
+    }
+
+    void TextureLoader::finish() {
+        while (pendingCount() > 0) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                resultReady.wait(lock, [this] { return !results.empty(); });
+            }
+            processUploads();
+        }
+    }
+
+    size_t TextureLoader::pendingCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending;
+    }
+
+    bool TextureLoader::runBatchItem(std::unique_lock<std::mutex>& lock, const std::shared_ptr<ParallelBatch>& batch) {
+        if (batch->next >= batch->count) {
+            return false;
+        }
+        size_t item = batch->next++;
+        if (batch->next == batch->count) {
+            batches.erase(std::find(batches.begin(), batches.end(), batch));
+        }
+
+        lock.unlock();
+        (*batch->task)(item);
+        lock.lock();
+
+        if (++batch->finished == batch->count) {
+            batch->done.notify_all();
+        }
+        return true;
+    }
+
+    void TextureLoader::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+        if (count == 0) {
+            return;
+        }
+
+        std::shared_ptr<ParallelBatch> batch = std::make_shared<ParallelBatch>();
+        batch->task = &task;
+        batch->count = count;
+        batch->next = 0;
+        batch->finished = 0;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        batches.push_back(batch);
+        jobReady.notify_all();
+        while (runBatchItem(lock, batch)) {
+        }
+        // only items already running on workers are left
+        batch->done.wait(lock, [&batch] { return batch->finished == batch->count; });
+    }
+
+    void TextureLoader::workerLoop() {
+        for (;;) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty() || !batches.empty(); });
+                if (stopping) {
+                    return;
+                }
+                // a batch has a caller waiting for it, so it goes before new decodes
+                if (!batches.empty()) {
+                    std::shared_ptr<ParallelBatch> batch = batches.front();
+                    runBatchItem(lock, batch);
+                    continue;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            Result result;
+            result.image = decode(job);
+            if (result.image.pixels && job.afterDecode) {
+                job.afterDecode(result.image);
+            }
+            result.onDecoded = job.onDecoded;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(result);
+            }
+            resultReady.notify_all();
+        }
+    }
+
+    DecodedImage TextureLoader::decode(const Job& job) {
+        DecodedImage image;
+        image.path = job.path;
+
+        int x, y, n;
+        unsigned char* image_data = stbi_load(job.path.c_str(), &x, &y, &n, job.forceChannels);
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", job.path.c_str());
+            return image;
+        }
+
+        int channels = job.forceChannels != 0 ? job.forceChannels : n;
+        if (job.flipVertically) {
+            flipRowsVertically(image_data, (size_t)x * channels, y);
+        }
+
+        image.width = x;
+        image.height = y;
+        image.channels = channels;
+        image.pixels = std::shared_ptr<unsigned char>(image_data, stbi_image_free);
+        return image;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef TextureLoader_hpp
+#define TextureLoader_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Pixels decoded by a worker; pixels is empty if the file could not be read
+    struct DecodedImage {
+        std::string path;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        std::shared_ptr<unsigned char> pixels;
+    };
+
+    // Pool of worker threads that decode image files in the background.
+    // Workers run stbi_load, the vertical flip and the channel conversion;
+    // the completion callbacks run on the GL thread inside processUploads().
+    class TextureLoader
+    {
+    public:
+        typedef std::function<void(const DecodedImage&)> UploadCallback;
+        // Extra CPU work done on the worker right after decoding, e.g. baking
+        typedef std::function<void(const DecodedImage&)> WorkerStep;
+
+        static TextureLoader& instance();
+
+        // Queues an image for decoding; onDecoded is called later from processUploads().
+        // forceChannels 0 keeps the channel count stored in the file.
+        void request(std::string path, int forceChannels, bool flipVertically, UploadCallback onDecoded,
+                     WorkerStep afterDecode = WorkerStep());
+
+        // Runs the callbacks of every finished image; call once per frame on the GL thread
+        void processUploads();
+
+        // Blocks until every queued image has been decoded and uploaded
+        void finish();
+
+        // Number of requested images whose callback has not run yet
+        size_t pendingCount();
+
+        // Runs task(0) .. task(count - 1) on the calling thread and every idle worker and returns
+        // once all of them have finished. The caller runs the items nobody else has picked up,
+        // so it may be called from a worker, e.g. by the bake step, even when the pool is busy.
+        void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    private:
+        struct Job {
+            std::string path;
+            int forceChannels;
+            bool flipVertically;
+            UploadCallback onDecoded;
+            WorkerStep afterDecode;
+        };
+
+        struct Result {
+            DecodedImage image;
+            UploadCallback onDecoded;
+        };
+
+        // Items of a parallelFor call; next and finished are guarded by the loader's mutex
+        struct ParallelBatch {
+            const std::function<void(size_t)>* task;
+            size_t count;
+            size_t next;
+            size_t finished;
+            std::condition_variable done;
+        };
+
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable jobReady;
+        std::condition_variable resultReady;
+        std::deque<Job> jobs;
+        std::deque<Result> results;
+        // batches that still have items nobody has started; served before the decode jobs
+        std::deque<std::shared_ptr<ParallelBatch> > batches;
+        size_t pending;
+        bool stopping;
+
+        TextureLoader();
+        ~TextureLoader();
+        TextureLoader(const TextureLoader&);
+        TextureLoader& operator=(const TextureLoader&);
+
+        void workerLoop();
+        // Runs the next item of a batch with the mutex released; false when none is left
+        bool runBatchItem(std::unique_lock<std::mutex>& lock, const std::shared_ptr<ParallelBatch>& batch);
+        static DecodedImage decode(const Job& job);
+    };
+}
+
+#endif /* TextureLoader_hpp */
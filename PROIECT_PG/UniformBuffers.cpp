@@ -0,0 +1,50 @@
+#include "UniformBuffers.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+    const char* uniformBlockName(UniformBlockBinding binding) {
+        switch (binding) {
+            case FRAME_UNIFORM_BINDING:
+                return "FrameUniforms";
+            case LIGHT_UNIFORM_BINDING:
+                return "LightUniforms";
+            case DRAW_UNIFORM_BINDING:
+                return "DrawUniforms";
+            default:
+                return "";
+        }
+    }
+
+    void UniformBuffer::create(UniformBlockBinding binding, size_t size) {
+        this->binding = binding;
+        buffer = genBuffer();
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer.get());
+        contents.clear();
+    }
+
+    void UniformBuffer::update(const void* data, size_t size) {
+        if (buffer.get() == 0) {
+            fprintf(stderr, "ERROR: uniform buffer %s updated before it was created\n", uniformBlockName(binding));
+            return;
+        }
+        if (contents.size() == size && std::memcmp(contents.data(), data, size) == 0) {
+            return;
+        }
+
+        const unsigned char* bytes = (const unsigned char*)data;
+        contents.assign(bytes, bytes + size);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    GLuint UniformBuffer::getBuffer() {
+        return buffer.get();
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef UniformBuffers_hpp
+#define UniformBuffers_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "GLHandle.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Fixed binding points of the shared uniform blocks. Shader binds a block to its point
+    // at link time when the program declares it, so one buffer serves every program.
+    enum UniformBlockBinding {
+        FRAME_UNIFORM_BINDING = 0,
+        LIGHT_UNIFORM_BINDING = 1,
+        // per-draw records in the UniformRing, bound with a range for each draw
+        DRAW_UNIFORM_BINDING = 2,
+        UNIFORM_BINDING_COUNT
+    };
+
+    // Block name the shaders have to use for a binding point
+    const char* uniformBlockName(UniformBlockBinding binding);
+
+    // std140 image of
+    //   layout(std140) uniform FrameUniforms {
+    //       mat4 view; mat4 projection; mat4 lightSpaceTrMatrix; vec4 cameraPosition;
+    //   };
+    struct FrameUniforms {
+        glm::mat4 view = glm::mat4(1.0f);
+        glm::mat4 projection = glm::mat4(1.0f);
+        glm::mat4 lightSpaceTrMatrix = glm::mat4(1.0f);
+        // world space, w = 1
+        glm::vec4 cameraPosition = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    };
+
+    const int MAX_POINT_LIGHTS = 8;
+
+    // Light vectors are in view space, like the plain uniforms they replace.
+    // Every member is initialized so unused lights compare equal between frames.
+    struct PointLightUniforms {
+        glm::vec4 position = glm::vec4(0.0f);
+        glm::vec4 direction = glm::vec4(0.0f);
+        glm::vec4 color = glm::vec4(0.0f);
+    };
+
+    // std140 image of
+    //   struct PointLight { vec4 position; vec4 direction; vec4 color; };
+    //   layout(std140) uniform LightUniforms {
+    //       vec4 d_lightDir; vec4 d_lightColor; PointLight pointLights[8]; int pointLightCount;
+    //   };
+    struct LightUniforms {
+        glm::vec4 directionalDirection = glm::vec4(0.0f);
+        glm::vec4 directionalColor = glm::vec4(0.0f);
+        PointLightUniforms pointLights[MAX_POINT_LIGHTS];
+        int32_t pointLightCount = 0;
+        // std140 rounds the block up to a multiple of 16 bytes
+        int32_t padding[3] = {0, 0, 0};
+    };
+
+    // std140 image of
+    //   layout(std140) uniform DrawUniforms {
+    //       mat4 model; mat3 normalMatrix; vec4 ambient; vec4 diffuse; vec4 specular;
+    //   };
+    // normalMatrix takes normals to view space, like the plain normalMatrix uniform.
+    struct DrawUniforms {
+        glm::mat4 model = glm::mat4(1.0f);
+        // mat3 columns are padded to vec4 in std140
+        glm::vec4 normalMatrix[3] = {glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)};
+        glm::vec4 ambient = glm::vec4(0.0f);
+        glm::vec4 diffuse = glm::vec4(0.0f);
+        glm::vec4 specular = glm::vec4(0.0f);
+    };
+
+    static_assert(sizeof(FrameUniforms) == 208, "FrameUniforms does not match the std140 layout");
+    static_assert(sizeof(LightUniforms) == 32 + 48 * MAX_POINT_LIGHTS + 16, "LightUniforms does not match the std140 layout");
+    static_assert(sizeof(DrawUniforms) == 160, "DrawUniforms does not match the std140 layout");
+
+    // A uniform buffer attached to one binding point for its whole life
+    class UniformBuffer
+    {
+    public:
+        void create(UniformBlockBinding binding, size_t size);
+
+        // Replaces the contents; skipped when they did not change since the last update
+        void update(const void* data, size_t size);
+
+        GLuint getBuffer();
+
+    private:
+        BufferHandle buffer;
+        UniformBlockBinding binding = FRAME_UNIFORM_BINDING;
+        // copy of what the buffer holds
+        std::vector<unsigned char> contents;
+    };
+}
+
+#endif /* UniformBuffers_hpp */
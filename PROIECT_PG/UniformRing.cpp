@@ -0,0 +1,280 @@
+#include "UniformRing.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    // Never destroyed, like the other GL registries
+    UniformRing& UniformRing::instance() {
+        static UniformRing* ring = new UniformRing();
+        return *ring;
+    }
+
+    void UniformRing::create(size_t frameBytes) {
+        GLint rangeAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &rangeAlignment);
+        alignment = rangeAlignment > 0 ? (size_t)rangeAlignment : 256;
+        this->frameBytes = (frameBytes + alignment - 1) / alignment * alignment;
+
+        for (int i = 0; i < UNIFORM_RING_FRAMES; i++) {
+            if (fences[i] != NULL) {
+                glDeleteSync(fences[i]);
+                fences[i] = NULL;
+            }
+        }
+        mapped = NULL;
+        staging.clear();
+        frame = 0;
+        head = 0;
+        flushed = 0;
+
+        buffer = genBuffer();
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            size_t size = this->frameBytes * UNIFORM_RING_FRAMES;
+            glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+            if (mapped == NULL) {
+                fprintf(stderr, "WARNING: could not map the uniform ring persistently, falling back to orphaning\n");
+                // immutable storage cannot be orphaned, so the fallback needs a new buffer
+                buffer = genBuffer();
+                glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+            }
+        }
+        if (mapped == NULL) {
+            glBufferData(GL_UNIFORM_BUFFER, this->frameBytes, NULL, GL_STREAM_DRAW);
+            staging.resize(this->frameBytes);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        std::cout << "Uniform ring : " << this->frameBytes / 1024 << " KB per frame, "
+            << (mapped != NULL ? "persistent mapping" : "orphaning") << std::endl;
+    }
+
+    bool UniformRing::isCreated() {
+        return buffer.get() != 0;
+    }
+
+    bool UniformRing::isPersistent() {
+        return mapped != NULL;
+    }
+
+    size_t UniformRing::segmentStart() {
+        return mapped != NULL ? frame * frameBytes : 0;
+    }
+
+    void UniformRing::beginFrame() {
+        head = 0;
+        flushed = 0;
+
+        if (mapped == NULL) {
+            // the draws of earlier frames keep reading the orphaned storage
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+            glBufferData(GL_UNIFORM_BUFFER, frameBytes, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            return;
+        }
+
+        GLsync fence = fences[frame];
+        if (fence == NULL) {
+            return;
+        }
+        // only waits when the GPU is a full ring of frames behind
+        GLbitfield flags = 0;
+        while (true) {
+            GLenum result = glClientWaitSync(fence, flags, 1000000000);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+                break;
+            }
+            if (result == GL_WAIT_FAILED) {
+                fprintf(stderr, "ERROR: waiting for the uniform ring fence failed\n");
+                break;
+            }
+            flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        }
+        glDeleteSync(fence);
+        fences[frame] = NULL;
+    }
+
+    void UniformRing::endFrame() {
+        if (mapped != NULL) {
+            fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            frame = (frame + 1) % UNIFORM_RING_FRAMES;
+        }
+    }
+
+    void* UniformRing::allocate(size_t size, GLintptr* offset) {
+        size_t start = (head + alignment - 1) / alignment * alignment;
+        if (start + size > frameBytes) {
+            if (!overflowReported) {
+                fprintf(stderr, "ERROR: uniform ring frame of %zu bytes is full, skipping the draws that do not fit\n", frameBytes);
+                overflowReported = true;
+            }
+            return NULL;
+        }
+
+        head = start + size;
+        *offset = (GLintptr)(segmentStart() + start);
+        return mapped != NULL ? mapped + segmentStart() + start : staging.data() + start;
+    }
+
+    void UniformRing::dropDraws(size_t count) {
+        droppedDraws += count;
+    }
+
+    size_t UniformRing::getDroppedDraws() {
+        return droppedDraws;
+    }
+
+    void UniformRing::flush() {
+        // the persistent mapping is coherent, so the writes are already visible
+        if (mapped == NULL && head > flushed) {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+            glBufferSubData(GL_UNIFORM_BUFFER, flushed, head - flushed, staging.data() + flushed);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        flushed = head;
+    }
+
+    void UniformRing::bindRange(UniformBlockBinding binding, GLintptr offset, size_t size) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer.get(), offset, size);
+    }
+
+    // ---- microbenchmark ----
+
+    static const char* BENCH_VERTEX_UNIFORMS =
+        "#version 410 core\n"
+        "layout(location = 0) in vec3 vPosition;\n"
+        "uniform mat4 model;\n"
+        "uniform mat3 normalMatrix;\n"
+        "uniform vec3 diffuse;\n"
+        "out vec3 color;\n"
+        "void main() { color = normalMatrix * diffuse; gl_Position = model * vec4(vPosition, 1.0); }\n";
+
+    static const char* BENCH_VERTEX_BLOCK =
+        "#version 410 core\n"
+        "layout(location = 0) in vec3 vPosition;\n"
+        "layout(std140) uniform DrawUniforms {\n"
+        "    mat4 model; mat3 normalMatrix; vec4 ambient; vec4 diffuse; vec4 specular;\n"
+        "};\n"
+        "out vec3 color;\n"
+        "void main() { color = normalMatrix * diffuse.rgb; gl_Position = model * vec4(vPosition, 1.0); }\n";
+
+    static const char* BENCH_FRAGMENT =
+        "#version 410 core\n"
+        "in vec3 color;\n"
+        "out vec4 fColor;\n"
+        "void main() { fColor = vec4(color, 1.0); }\n";
+
+    static GLuint compileBenchProgram(const char* vertexSource) {
+        const char* sources[2] = {vertexSource, BENCH_FRAGMENT};
+        GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+        GLuint program = glCreateProgram();
+        for (int i = 0; i < 2; i++) {
+            GLuint shader = glCreateShader(types[i]);
+            glShaderSource(shader, 1, &sources[i], NULL);
+            glCompileShader(shader);
+            glAttachShader(program, shader);
+            glDeleteShader(shader);
+        }
+        glLinkProgram(program);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            fprintf(stderr, "ERROR: draw submission benchmark program did not link\n");
+        }
+        return program;
+    }
+
+    void UniformRing::benchmark() {
+        const int drawsPerFrame = 4096;
+        const int frames = 16;
+
+        GLint rangeAlignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &rangeAlignment);
+        size_t recordBytes = (sizeof(DrawUniforms) + rangeAlignment - 1) / rangeAlignment * rangeAlignment;
+        UniformRing& ring = instance();
+        ring.create(drawsPerFrame * recordBytes);
+
+        GLuint uniformProgram = compileBenchProgram(BENCH_VERTEX_UNIFORMS);
+        GLuint blockProgram = compileBenchProgram(BENCH_VERTEX_BLOCK);
+        glUniformBlockBinding(blockProgram, glGetUniformBlockIndex(blockProgram, "DrawUniforms"), DRAW_UNIFORM_BINDING);
+        GLint modelLocation = glGetUniformLocation(uniformProgram, "model");
+        GLint normalMatrixLocation = glGetUniformLocation(uniformProgram, "normalMatrix");
+        GLint diffuseLocation = glGetUniformLocation(uniformProgram, "diffuse");
+
+        // one tiny triangle, so the GPU side stays negligible
+        const GLfloat triangle[9] = {0.0f, 0.0f, 0.0f, 0.001f, 0.0f, 0.0f, 0.0f, 0.001f, 0.0f};
+        VertexArrayHandle VAO = genVertexArray();
+        BufferHandle VBO = genBuffer();
+        glBindVertexArray(VAO.get());
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(triangle), triangle, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+
+        DrawUniforms draw;
+        glm::mat3 normalMatrix(1.0f);
+
+        glUseProgram(uniformProgram);
+        double uniformSeconds = 0.0;
+        for (int f = 0; f <= frames; f++) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < drawsPerFrame; i++) {
+                // a different value every draw, so nothing can be skipped as redundant
+                draw.model[3].x = i * 1e-6f;
+                glUniformMatrix4fv(modelLocation, 1, GL_FALSE, &draw.model[0][0]);
+                glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, &normalMatrix[0][0]);
+                glUniform3fv(diffuseLocation, 1, &draw.diffuse[0]);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            // the first frame warms up the driver
+            if (f > 0) {
+                uniformSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            glFinish();
+        }
+
+        glUseProgram(blockProgram);
+        std::vector<GLintptr> offsets(drawsPerFrame);
+        double ringSeconds = 0.0;
+        for (int f = 0; f <= frames; f++) {
+            auto start = std::chrono::steady_clock::now();
+            ring.beginFrame();
+            for (int i = 0; i < drawsPerFrame; i++) {
+                draw.model[3].x = i * 1e-6f;
+                void* record = ring.allocate(sizeof(DrawUniforms), &offsets[i]);
+                if (record != NULL) {
+                    std::memcpy(record, &draw, sizeof(DrawUniforms));
+                }
+            }
+            ring.flush();
+            for (int i = 0; i < drawsPerFrame; i++) {
+                ring.bindRange(DRAW_UNIFORM_BINDING, offsets[i], sizeof(DrawUniforms));
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            ring.endFrame();
+            if (f > 0) {
+                ringSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            glFinish();
+        }
+
+        glBindVertexArray(0);
+        glUseProgram(0);
+        glDeleteProgram(uniformProgram);
+        glDeleteProgram(blockProgram);
+
+        double draws = (double)drawsPerFrame * frames;
+        double before = uniformSeconds / draws * 1e9;
+        double after = ringSeconds / draws * 1e9;
+        std::cout << "Draw submission (" << (ring.isPersistent() ? "persistent ring" : "orphaned ring") << "), "
+            << drawsPerFrame << " draws x " << frames << " frames:" << std::endl;
+        std::cout << "  per draw : " << before << " ns with glUniform -> " << after << " ns with the ring ("
+            << before / after << "x)" << std::endl;
+    }
+}
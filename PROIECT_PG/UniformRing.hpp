@@ -0,0 +1,75 @@
+#ifndef UniformRing_hpp
+#define UniformRing_hpp
+
+#include <GL/glew.h>
+
+#include "GLHandle.hpp"
+#include "UniformBuffers.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Number of frames the GPU may still be reading while the CPU writes the next one
+    const int UNIFORM_RING_FRAMES = 3;
+
+    // Per-draw uniform data written linearly into one buffer and bound with glBindBufferRange.
+    // With ARB_buffer_storage the buffer is mapped once, persistently, and split into one
+    // segment per frame in flight; a fence per segment keeps the CPU from overwriting data
+    // the GPU has not read yet. On plain 4.1 the records are staged in memory and uploaded
+    // into a buffer that is orphaned every frame, so the driver does the tracking.
+    // Must only be used from the thread that owns the GL context.
+    class UniformRing
+    {
+    public:
+        static UniformRing& instance();
+
+        // Allocates the buffer; frameBytes bounds the data of a single frame
+        void create(size_t frameBytes);
+        bool isCreated();
+        bool isPersistent();
+
+        // Waits until the segment of this frame is no longer read by the GPU
+        void beginFrame();
+        // Fences the commands that read this frame's segment
+        void endFrame();
+
+        // Room for one record at the offset alignment GL requires for ranges; NULL when the
+        // frame's segment is full. The pointer is valid until flush().
+        void* allocate(size_t size, GLintptr* offset);
+
+        // Counts draws skipped because their record did not fit
+        void dropDraws(size_t count);
+        size_t getDroppedDraws();
+
+        // Makes the records allocated so far visible to the draws that follow
+        void flush();
+
+        void bindRange(UniformBlockBinding binding, GLintptr offset, size_t size);
+
+        // Times glUniform uploads against ring records for the same draws and prints the cost per draw
+        static void benchmark();
+
+    private:
+        BufferHandle buffer;
+        // persistent mapping of the whole buffer, or NULL when falling back to orphaning
+        unsigned char* mapped = NULL;
+        // staging copy of the current frame for the fallback
+        std::vector<unsigned char> staging;
+        GLsync fences[UNIFORM_RING_FRAMES] = {};
+        size_t frameBytes = 0;
+        size_t alignment = 256;
+        int frame = 0;
+        // write position inside the current segment and the part of it already uploaded
+        size_t head = 0;
+        size_t flushed = 0;
+        bool overflowReported = false;
+        size_t droppedDraws = 0;
+
+        // start of the current frame's segment in the buffer
+        size_t segmentStart();
+    };
+}
+
+#endif /* UniformRing_hpp */
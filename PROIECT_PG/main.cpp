@@ -19,10 +19,17 @@
 
 #include "Window.h"
 #include "Shader.hpp"
+#include "ProgramCache.hpp"
+#include "UniformBuffers.hpp"
+#include "UniformRing.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
+#include "TextureCache.hpp"
+#include "ImageKernels.hpp"
+#include "AllocationCounter.hpp"
 
+#include <chrono>
 #include <iostream>
 
 int glWindowWidth = M_WIDTH;
@@ -60,20 +67,29 @@ glm::vec3 p_lightDir;
 glm::vec3 p_lightColor;
 glm::vec3 p_lightSourceColor(0.647f, 0.165f, 0.165f);
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-GLuint lightSourceColorLoc;
-GLuint d_lightDirLoc;
-GLuint d_lightColorLoc;
-GLuint p_lightPosLoc;
-GLuint p_lightDirLoc;
-GLuint p_lightColorLoc;
-GLuint skyboxLoc;
+// shader uniform names, hashed at compile time
+constexpr gps::UniformName MODEL_UNIFORM("model");
+constexpr gps::UniformName VIEW_UNIFORM("view");
+constexpr gps::UniformName PROJECTION_UNIFORM("projection");
+constexpr gps::UniformName NORMAL_MATRIX_UNIFORM("normalMatrix");
+constexpr gps::UniformName LIGHT_SOURCE_COLOR_UNIFORM("lightSourceColor");
+constexpr gps::UniformName D_LIGHT_DIR_UNIFORM("d_lightDir");
+constexpr gps::UniformName D_LIGHT_COLOR_UNIFORM("d_lightColor");
+constexpr gps::UniformName P_LIGHT_POS_UNIFORM("p_lightPos");
+constexpr gps::UniformName P_LIGHT_DIR_UNIFORM("p_lightDir");
+constexpr gps::UniformName P_LIGHT_COLOR_UNIFORM("p_lightColor");
+constexpr gps::UniformName LIGHT_SPACE_UNIFORM("lightSpaceTrMatrix");
+constexpr gps::UniformName SHADOW_MAP_UNIFORM("shadowMap");
+constexpr gps::UniformName DEPTH_MAP_UNIFORM("depthMap");
+
+// per-draw transforms and materials of one frame; 1024 records at the usual 256 byte alignment
+const size_t DRAW_RING_FRAME_BYTES = 256 * 1024;
+
+// frame constants and lights shared by every program, written once per frame
+gps::UniformBuffer frameUniformBuffer;
+gps::UniformBuffer lightUniformBuffer;
+gps::FrameUniforms frameUniforms;
+gps::LightUniforms lightUniforms;
 
 // cameras
 gps::Camera editModeCamera(
@@ -139,6 +155,16 @@ GLuint shadowMapFBO;
 GLuint depthMapTexture;
 bool showDepthMap;
 
+// level of detail - cycled with the V key, -1 selects by screen size
+int forcedLod = -1;
+// allowed simplification error in pixels; the shadow map can live with coarser meshes
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_SHADOW_PIXEL_ERROR = 4.0f;
+
+// cluster culling results of the last frame
+gps::CullStats shadowCullStats;
+gps::CullStats sceneCullStats;
+
 // GUI variables
 ImVec2 prevWindows;
 
@@ -180,11 +206,8 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
     // get the new dimensions of the window
     glfwGetFramebufferSize(myWindow.getWindow(), &retina_width, &retina_height);
     
-    // recompute the projection matrix and send it to the shader
-    myCustomShader.useShaderProgram();
+    // recompute the projection matrix; it reaches the shaders with the next frame's uniforms
     projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-    projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
     
     // redraw the window
     glViewport(0, 0, retina_width, retina_height);
@@ -211,6 +234,13 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
     if (key == GLFW_KEY_P && action == GLFW_PRESS)
         toggleLights = !toggleLights;
     
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        forcedLod = forcedLod >= 3 ? -1 : forcedLod + 1;
+        starFighter.setForcedLod(forcedLod);
+        terrain.setForcedLod(forcedLod);
+        printf("LOD: %d\n", forcedLod);
+    }
+    
     if (key == GLFW_KEY_ENTER && action == GLFW_PRESS) {
         editMode = !editMode;
         if (editMode) {
@@ -295,10 +325,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
         }
     
         activeCamera->setCameraFrontDirection(glm::normalize(direction));
-        
-        view = activeCamera->getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 }
 
 void processMovement() {
@@ -365,12 +391,6 @@ void processMovement() {
             shipZ += cameraSpeed;
         }
         activeCamera->move(gps::MOVE_FORWARD, cameraSpeed);
-        //update view matrix
-        view = activeCamera->getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
     
     if (pressedKeys[GLFW_KEY_S]) {
@@ -378,12 +398,6 @@ void processMovement() {
             shipZ -= cameraSpeed;
         }
         activeCamera->move(gps::MOVE_BACKWARD, cameraSpeed);
-        //update view matrix
-        view = activeCamera->getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     }
     
     if (pressedKeys[GLFW_KEY_A]) {
@@ -394,12 +408,6 @@ void processMovement() {
                 shipAngleZ = -44.0f;
         }
         activeCamera->move(gps::MOVE_LEFT, cameraSpeed);
-        //update view matrix
-        view = activeCamera->getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     } else {
         if (!editMode) {
             if (shipAngleZ < 0.0f)
@@ -415,12 +423,6 @@ void processMovement() {
                 shipAngleZ = 45.0f;
         }
         activeCamera->move(gps::MOVE_RIGHT, cameraSpeed);
-        //update view matrix
-        view = activeCamera->getViewMatrix();
-        myCustomShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        // compute normal matrix for teapot
-        normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
     } else {
         if (!editMode) {
             if (shipAngleZ > 0.0f)
@@ -502,7 +504,10 @@ void initModels() {
     //    teapot.LoadModel("models/teapot/teapot20segUT.obj");
     lightCube.LoadModel("models/cube/cube.obj");
     screenQuad.LoadModel("models/quad/quad.obj");
+    // the big models use the packed 16 byte vertex layout
+    starFighter.setVertexFormat(gps::VERTEX_FORMAT_PACKED);
     starFighter.LoadModel("models/star-fighter/star-fighter.obj");
+    terrain.setVertexFormat(gps::VERTEX_FORMAT_PACKED);
     terrain.LoadModel("models/terrain/terrain.obj");
     lightSphere.LoadModel("models/sphere/wooden_sphere.obj");
     faces.push_back("models/skybox/redplanet/right.tga");
@@ -514,89 +519,70 @@ void initModels() {
     mySkyBox.Load(faces);
 }
 
+// compile start, so finishShaders can report how long the programs took including the overlap
+std::chrono::steady_clock::time_point shadersStart;
+
+// Submits every program without waiting; the driver compiles them while the models load
 void initShaders() {
-    myCustomShader.loadShader(
-                              "shaders/shaderStart.vert",
-                              "shaders/shaderStart.frag");
-    myCustomShader.useShaderProgram();
-    lightShader.loadShader(
-                           "shaders/lightCube.vert",
-                           "shaders/lightCube.frag");
-    lightShader.useShaderProgram();
-    screenQuadShader.loadShader(
-                                "shaders/screenQuad.vert",
-                                "shaders/screenQuad.frag");
-    screenQuadShader.useShaderProgram();
-    depthMapShader.loadShader(
-                              "shaders/depthMapShader.vert",
-                              "shaders/depthMapShader.frag");
-    depthMapShader.useShaderProgram();
-    skyboxShader.loadShader(
-                            "shaders/skyboxShader.vert",
-                            "shaders/skyboxShader.frag");
-    skyboxShader.useShaderProgram();
+    shadersStart = std::chrono::steady_clock::now();
+    myCustomShader.loadShaderAsync(
+                                   "shaders/shaderStart.vert",
+                                   "shaders/shaderStart.frag");
+    lightShader.loadShaderAsync(
+                                "shaders/lightCube.vert",
+                                "shaders/lightCube.frag");
+    screenQuadShader.loadShaderAsync(
+                                     "shaders/screenQuad.vert",
+                                     "shaders/screenQuad.frag");
+    depthMapShader.loadShaderAsync(
+                                   "shaders/depthMapShader.vert",
+                                   "shaders/depthMapShader.frag");
+    skyboxShader.loadShaderAsync(
+                                 "shaders/skyboxShader.vert",
+                                 "shaders/skyboxShader.frag");
 }
 
-void initUniforms() {
-    myCustomShader.useShaderProgram();
+void finishShaders() {
+    gps::Shader* shaders[5] = {&myCustomShader, &lightShader, &screenQuadShader, &depthMapShader, &skyboxShader};
+    size_t readyBeforeWait = 0;
+    for (int i = 0; i < 5; i++) {
+        if (shaders[i]->isReady()) {
+            readyBeforeWait++;
+        }
+        shaders[i]->wait();
+    }
     
+    gps::ProgramCacheStats cacheStats = gps::ProgramCache::getStats();
+    double shadersMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shadersStart).count();
+    printf("Shaders ready in %.1f ms, %zu of 5 reported complete before waiting (program cache: %zu hits, %zu misses, %zu rejected)\n",
+           shadersMs, readyBeforeWait, cacheStats.hits, cacheStats.misses, cacheStats.rejected);
+}
+
+void initUniforms() {
     editModeCamera.setCameraFrontDirection(glm::vec3(0.0f, 0.0f, -3.0f));
     viewModeCamera.setCameraFrontDirection(glm::vec3(0.0f, 0.0f,  1.0f));
     
     model = glm::mat4(1.0f);
-    modelLoc = glGetUniformLocation(myCustomShader.shaderProgram, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    
     view = activeCamera->getViewMatrix();
-    viewLoc = glGetUniformLocation(myCustomShader.shaderProgram, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    
     normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-    normalMatrixLoc = glGetUniformLocation(myCustomShader.shaderProgram, "normalMatrix");
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    
     projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-    projectionLoc = glGetUniformLocation(myCustomShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    
-    lightSourceColorLoc = glGetUniformLocation(lightShader.shaderProgram, "lightSourceColor");
     
     /// ---------------------------------------------------- DIRECTIONAL LIGHT -----------------------------------------------------------------
     //set the light direction (direction towards the light)
     d_lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
     d_lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(firstLightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-    d_lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "d_lightDir");
-    glUniform3fv(d_lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * d_lightRotation)) * d_lightDir));
-    
-    //set light color
-    d_lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "d_lightColor");
-    glUniform3fv(d_lightColorLoc, 1, glm::value_ptr(d_lightSourceColor));
-    
     
     /// ------------------------------------------------------- POINT LIGHT -------------------------------------------------------------------
     // set the light position
     p_lightPos = glm::vec3(secondLightY, secondLightX, secondLightZ);
-    p_lightPosLoc = glGetUniformLocation(myCustomShader.shaderProgram, "p_lightPos");
-    glUniform3fv(p_lightPosLoc, 1, glm::value_ptr(glm::vec3(view * glm::vec4(p_lightPos, 1.0f))));
     
     // set the light direction (direction towards the light)
     p_lightDir = glm::vec3(0.0f, 0.0f, 1.0f);
-    p_lightDirLoc = glGetUniformLocation(myCustomShader.shaderProgram, "p_lightDir");
-    glUniform3fv(p_lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view)) * p_lightDir));
-    
-    // set light color
-    p_lightColorLoc = glGetUniformLocation(myCustomShader.shaderProgram, "p_lightColor");
-    glUniform3fv(p_lightColorLoc, 1, glm::value_ptr(p_lightSourceColor));
-    
-    lightShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    
-    skyboxShader.useShaderProgram();
-    view = activeCamera->getViewMatrix();
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
     
-    projection = glm::perspective(glm::radians(45.0f), (float)retina_width / (float)retina_height, 0.1f, 1000.0f);
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    // the blocks are attached to their binding points once; programs find them there
+    frameUniformBuffer.create(gps::FRAME_UNIFORM_BINDING, sizeof(gps::FrameUniforms));
+    lightUniformBuffer.create(gps::LIGHT_UNIFORM_BINDING, sizeof(gps::LightUniforms));
+    gps::UniformRing::instance().create(DRAW_RING_FRAME_BYTES);
 }
 
 void initFBO() {
@@ -630,6 +616,45 @@ glm::mat4 computeLightSpaceTrMatrix() {
     return lightProjection * lightView;
 }
 
+// Computes the camera and light state of this frame and writes it to the shared blocks
+void updateFrameUniforms() {
+    view = activeCamera->getViewMatrix();
+    d_lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(firstLightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+    p_lightPos = glm::vec3(secondLightY, secondLightX, secondLightZ);
+    
+    // also moves d_lightDir to the GUI position, so it goes first
+    frameUniforms.lightSpaceTrMatrix = computeLightSpaceTrMatrix();
+    frameUniforms.view = view;
+    frameUniforms.projection = projection;
+    frameUniforms.cameraPosition = glm::inverse(view)[3];
+    frameUniformBuffer.update(&frameUniforms, sizeof(frameUniforms));
+    
+    lightUniforms.directionalDirection = glm::vec4(glm::inverseTranspose(glm::mat3(view * d_lightRotation)) * d_lightDir, 0.0f);
+    lightUniforms.directionalColor = glm::vec4(d_lightSourceColor, 1.0f);
+    lightUniforms.pointLights[0].position = view * glm::vec4(p_lightPos, 1.0f);
+    lightUniforms.pointLights[0].direction = glm::vec4(glm::inverseTranspose(glm::mat3(view)) * p_lightDir, 0.0f);
+    lightUniforms.pointLights[0].color = glm::vec4(glm::make_vec3(lightSourceColorPicker), 1.0f);
+    lightUniforms.pointLightCount = 1;
+    lightUniformBuffer.update(&lightUniforms, sizeof(lightUniforms));
+}
+
+// Programs without the shared blocks get the frame values as plain uniforms.
+// The program has to be in use; values it already holds are not uploaded again.
+void setPlainFrameUniforms(gps::Shader& shader) {
+    if (!shader.hasUniformBlock(gps::FRAME_UNIFORM_BINDING)) {
+        shader.setMat4(VIEW_UNIFORM, frameUniforms.view);
+        shader.setMat4(PROJECTION_UNIFORM, frameUniforms.projection);
+        shader.setMat4(LIGHT_SPACE_UNIFORM, frameUniforms.lightSpaceTrMatrix);
+    }
+    if (!shader.hasUniformBlock(gps::LIGHT_UNIFORM_BINDING)) {
+        shader.setVec3(D_LIGHT_DIR_UNIFORM, glm::vec3(lightUniforms.directionalDirection));
+        shader.setVec3(D_LIGHT_COLOR_UNIFORM, glm::vec3(lightUniforms.directionalColor));
+        shader.setVec3(P_LIGHT_POS_UNIFORM, glm::vec3(lightUniforms.pointLights[0].position));
+        shader.setVec3(P_LIGHT_DIR_UNIFORM, glm::vec3(lightUniforms.pointLights[0].direction));
+        shader.setVec3(P_LIGHT_COLOR_UNIFORM, glm::vec3(lightUniforms.pointLights[0].color));
+    }
+}
+
 void levitateShip() {
     if (!editMode) {
         if (goingUp && levitation <= 0.1f) {
@@ -646,42 +671,60 @@ void levitateShip() {
     }
 }
 
-void drawObjects(gps::Shader shader, bool depthPass) {
+void drawObjects(gps::Shader& shader, bool depthPass) {
     
     shader.useShaderProgram();
     
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.5f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    // programs with the DrawUniforms block get model and normal matrix per draw from the ring
+    if (!shader.hasUniformBlock(gps::DRAW_UNIFORM_BINDING)) {
+        model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -1.0f, 0.0f));
+        model = glm::scale(model, glm::vec3(0.5f));
+        shader.setMat4(MODEL_UNIFORM, model);
+        
+        // do not send the normal matrix if we are rendering in the depth map
+        if (!depthPass) {
+            normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+            shader.setMat3(NORMAL_MATRIX_UNIFORM, normalMatrix);
+        }
+    }
     
-    // do not send the normal matrix if we are rendering in the depth map
-    if (!depthPass) {
-        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+    gps::LodSelection lodSelection;
+    lodSelection.cameraPosition = glm::vec3(glm::inverse(view)[3]);
+    lodSelection.projectionScale = (float)retina_height / (2.0f * tanf(glm::radians(45.0f) / 2.0f));
+    lodSelection.pixelError = depthPass ? LOD_SHADOW_PIXEL_ERROR : LOD_PIXEL_ERROR;
+    
+    // the shadow pass looks along the light direction with an orthographic projection
+    gps::CullView cullView;
+    if (depthPass) {
+        cullView.viewProjection = computeLightSpaceTrMatrix();
+        cullView.eye = glm::vec4(-glm::normalize(glm::mat3(d_lightRotation) * d_lightDir), 0.0f);
+    } else {
+        cullView.viewProjection = projection * view;
+        cullView.eye = glm::inverse(view)[3];
     }
+    gps::CullStats* cullStats = depthPass ? &shadowCullStats : &sceneCullStats;
+    *cullStats = gps::CullStats();
     
     model = glm::translate(glm::mat4(1.0f), glm::vec3(shipX, shipY, shipZ));
     model = glm::scale(model, glm::vec3(shipScale));
     model = glm::rotate(model, glm::radians(shipAngleX), glm::vec3(1.0f, 0.0f, 0.0f));
     model = glm::rotate(model, glm::radians(shipAngleY), glm::vec3(0.0f, 1.0f, 0.0f));
     model = glm::rotate(model, glm::radians(shipAngleZ), glm::vec3(0.0f, 0.0f, 1.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    starFighter.Draw(shader);
+    starFighter.Draw(shader, model, view, lodSelection, &cullView, cullStats);
     
     model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-    terrain.Draw(shader);
+    terrain.Draw(shader, model, view, lodSelection, &cullView, cullStats);
 }
 
 void renderScene() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     levitateShip();
+    updateFrameUniforms();
+    gps::UniformRing::instance().beginFrame();
     
     // depth maps creation pass
-    d_lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(firstLightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
     depthMapShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1,
-                       GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+    setPlainFrameUniforms(depthMapShader);
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
     glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
     glClear(GL_DEPTH_BUFFER_BIT);
@@ -701,7 +744,7 @@ void renderScene() {
         //bind the depth map
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+        screenQuadShader.setInt(DEPTH_MAP_UNIFORM, 0);
         
         glDisable(GL_DEPTH_TEST);
         screenQuad.Draw(screenQuadShader);
@@ -713,60 +756,42 @@ void renderScene() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         
         myCustomShader.useShaderProgram();
-        
-        view = activeCamera->getViewMatrix();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-        glUniform3fv(p_lightPosLoc, 1, glm::value_ptr(glm::vec3(view * glm::vec4(p_lightPos, 1.0f))));
-        
-        d_lightRotation = glm::rotate(glm::mat4(1.0f), glm::radians(firstLightAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-        glUniform3fv(d_lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * d_lightRotation)) * d_lightDir));
+        setPlainFrameUniforms(myCustomShader);
         
         //bind the shadow map
         glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-        glUniform1i(glGetUniformLocation(myCustomShader.shaderProgram, "shadowMap"), 3);
-        
-        glUniformMatrix4fv(glGetUniformLocation(myCustomShader.shaderProgram, "lightSpaceTrMatrix"),
-                           1,
-                           GL_FALSE,
-                           glm::value_ptr(computeLightSpaceTrMatrix()));
-        
-        p_lightPos = glm::vec3(secondLightY, secondLightX, secondLightZ);
-        glUniform3fv(p_lightPosLoc, 1, glm::value_ptr(glm::vec3(view * glm::vec4(p_lightPos, 1.0f))));
-        
-        // point light color
-        glUniform3fv(p_lightColorLoc, 1, glm::value_ptr(glm::make_vec3(lightSourceColorPicker)));
+        myCustomShader.setInt(SHADOW_MAP_UNIFORM, 3);
         
         drawObjects(myCustomShader, false);
         
         //draw a white cube around the directional light
         lightShader.useShaderProgram();
-        
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        setPlainFrameUniforms(lightShader);
         
         model = d_lightRotation;
         model = glm::translate(model, 1.0f * d_lightDir);
         model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
         // cube color
-        glUniform3fv(lightSourceColorLoc, 1, glm::value_ptr(d_lightSourceColor));
+        lightShader.setVec3(LIGHT_SOURCE_COLOR_UNIFORM, d_lightSourceColor);
         if (editMode) {
-            lightCube.Draw(lightShader);
+            lightCube.Draw(lightShader, model, view);
         }
         
         // draw a sphere around the point light
         model = glm::mat4(1.0f);
         model = glm::translate(model, 1.0f * p_lightPos);
         model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        glUniformMatrix4fv(glGetUniformLocation(lightShader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
         // sphere color
-        glUniform3fv(lightSourceColorLoc, 1, glm::value_ptr(glm::make_vec3(lightSourceColorPicker)));
+        lightShader.setVec3(LIGHT_SOURCE_COLOR_UNIFORM, glm::make_vec3(lightSourceColorPicker));
         if (editMode) {
-            lightSphere.Draw(lightShader);
+            lightSphere.Draw(lightShader, model, view);
         }
         
         mySkyBox.Draw(skyboxShader, view, projection);
     }
+    
+    gps::UniformRing::instance().endFrame();
 }
 
 void cleanup() {
@@ -824,13 +849,76 @@ void createGUI() {
     prevWindows.y += ImGui::GetWindowSize().y;
     ImGui::End();
     
+    // create GUI window for the culling counters
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 40.0f + prevWindows.y));
+    ImGui::Begin("Culling", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+    const gps::CullStats* passStats[2] = {&sceneCullStats, &shadowCullStats};
+    const char* passNames[2] = {"Scene", "Shadow"};
+    for (int i = 0; i < 2; i++) {
+        ImGui::Text("%s: %zu triangles drawn, %zu of %zu clusters", passNames[i], passStats[i]->trianglesDrawn,
+                    passStats[i]->clustersDrawn, passStats[i]->clustersTested);
+        ImGui::Text("  culled: %zu frustum, %zu backface", passStats[i]->trianglesFrustumCulled,
+                    passStats[i]->trianglesBackfaceCulled);
+    }
+    // draws whose uniform record did not fit in the ring are skipped, not drawn with stale data
+    ImGui::Text("Draws skipped (uniform ring full): %zu", gps::UniformRing::instance().getDroppedDraws());
+    ImGui::End();
+    
     // end ImGui frame
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+// Offline step: bakes the mip chain of every image given after --bake-textures, with the
+// color space, block format and encoder quality of a material role. Images are baked as
+// diffuse maps until a "--role <type>" argument selects another role for the ones after it;
+// the settings are stamped in the baked file, so the runtime only uses it for that role.
+int bakeTextures(int argc, const char * argv[]) {
+    std::string role = "diffuseTexture";
+    int failures = 0;
+    for (int i = 2; i < argc; i++) {
+        if (std::string(argv[i]) == "--role") {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "ERROR: --role needs a material role, e.g. specularTexture\n");
+                return EXIT_FAILURE;
+            }
+            role = argv[++i];
+            continue;
+        }
+        
+        gps::TextureBakeSettings settings = gps::TextureCache::instance().getBakeSettings(role);
+        gps::TextureColorSpace colorSpace = gps::TextureCache::colorSpaceFor(role);
+        std::string path = argv[i];
+        std::shared_ptr<bool> baked = std::make_shared<bool>(false);
+        gps::TextureLoader::instance().request(path, 0, true, [path, role, colorSpace, settings, baked, &failures](const gps::DecodedImage&) {
+            if (*baked) {
+                std::cout << "Baked : " << gps::BakedTexture::bakedPathFor(path, colorSpace, settings.format, settings.quality) << " (" << role << ")" << std::endl;
+            } else {
+                failures++;
+            }
+        }, [path, baked, colorSpace, settings](const gps::DecodedImage& image) {
+            *baked = gps::BakedTexture::write(path, image.pixels.get(), image.width, image.height, image.channels, colorSpace,
+                                              settings.format, settings.quality);
+        });
+    }
+    gps::TextureLoader::instance().finish();
+    
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, const char * argv[]) {
     
+    if (argc > 1 && std::string(argv[1]) == "--bake-textures") {
+        return bakeTextures(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--bench-image-kernels") {
+        gps::benchmarkImageKernels();
+        return EXIT_SUCCESS;
+    }
+    // LoadModel needs a GL context for the uploads, so the window is opened first
+    bool benchLoads = argc > 2 && std::string(argv[1]) == "--bench-load";
+    bool benchDraws = argc > 1 && std::string(argv[1]) == "--bench-draw-submission";
+    
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -838,9 +926,22 @@ int main(int argc, const char * argv[]) {
         return EXIT_FAILURE;
     }
     
+    if (benchLoads) {
+        gps::benchmarkModelLoads(argc - 2, argv + 2);
+        myWindow.Delete();
+        return EXIT_SUCCESS;
+    }
+    if (benchDraws) {
+        gps::UniformRing::benchmark();
+        myWindow.Delete();
+        return EXIT_SUCCESS;
+    }
+    
     initOpenGLState();
-    initModels();
+    // shaders compile on driver threads while the models and textures load
     initShaders();
+    initModels();
+    finishShaders();
     initUniforms();
     initFBO();
     setWindowCallbacks();
@@ -859,7 +960,14 @@ int main(int argc, const char * argv[]) {
     ImGui_ImplOpenGL3_Init(glsl_version);
     
     // application loop
+    bool textureReportPrinted = false;
     while (!glfwWindowShouldClose(myWindow.getWindow())) {
+        // upload the textures the decode workers finished since the last frame
+        gps::TextureLoader::instance().processUploads();
+        if (!textureReportPrinted && gps::TextureLoader::instance().pendingCount() == 0) {
+            gps::TextureCache::instance().printReport();
+            textureReportPrinted = true;
+        }
         processMovement();
         renderScene();
         glfwPollEvents();
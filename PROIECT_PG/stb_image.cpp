@@ -1,2 +1,7 @@
 #define STB_IMAGE_IMPLEMENTATION
+// decode buffers are recycled through the staging pool
+#include "StagingPool.hpp"
+#define STBI_MALLOC(sz)           gps::stagingAlloc(sz)
+#define STBI_REALLOC(p,newsz)     gps::stagingRealloc(p,newsz)
+#define STBI_FREE(p)              gps::stagingFree(p)
 #include "stb_image.h"
\ No newline at end of file